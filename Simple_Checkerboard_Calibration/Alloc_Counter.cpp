@@ -0,0 +1,41 @@
+#include "Alloc_Counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Replacement of the global operator new of this executable(see Alloc_Counter.h).
+// Only compiled in with CALIB_COUNT_ALLOCS.
+#ifdef CALIB_COUNT_ALLOCS
+void* operator new(std::size_t size)
+{
+    AllocationCounter()++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+
+#include <opencv2/core.hpp>
+
+// Allocation counting test hook, enabled by CALIB_COUNT_ALLOCS.
+// Two sources are counted : operator new of this executable(replaced in Alloc_Counter.cpp) and the cv::Mat buffers
+// (a counting MatAllocator). OpenCV is linked as DLLs, so the operator new of opencv_core, like the UMatData
+// headers and other internal scratch, is not seen.
+inline std::atomic<long long>& AllocationCounter()
+{
+    static std::atomic<long long> counter{ 0 };
+    return counter;
+}
+
+// Allocations since the start(-1 : the hook is not compiled in)
+inline long long AllocationCount()
+{
+#ifdef CALIB_COUNT_ALLOCS
+    return AllocationCounter().load();
+#else
+    return -1;
+#endif
+}
+
+// Default cv::Mat allocator that counts every buffer, the memory itself comes from the standard allocator
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags,
+        cv::UMatUsageFlags usageFlags) const override
+    {
+        AllocationCounter()++;
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(data, accessflags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+// Count the cv::Mat buffers from now on(nothing without CALIB_COUNT_ALLOCS)
+inline void InstallAllocationCounter()
+{
+#ifdef CALIB_COUNT_ALLOCS
+    static CountingMatAllocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+#endif
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <opencv2/highgui.hpp>
+
+#include "Calib_Common.h"
+#include "Calib_Quality.h"
+#include "Coverage_Map.h"
+#include "Frame_Source.h"
+
+#define AUTO_CAPTURE_INTERVAL (5)   // # Kept views between two background calibrations
+#define AUTO_CAPTURE_MAX     (60)   // # Kept views at most
+
+// Acquire mode : detect on the stream, keep the sharp, well exposed views that add coverage or a new pose,
+// and calibrate in the background as they accumulate. Stops once the calibration meets the quality target.
+// saveDir : the kept frames are written there as N.jpg(empty : not saved)
+inline int RunAutoCapture(int boardRows, int boardCols, float boardSize, const std::string& spec, const std::string& saveDir)
+{
+    cv::Ptr<FrameSource> source = CreateFrameSource(spec);
+    if (!source)
+        return -1;
+    // a camera gets a preview window, a recorded source runs headless
+    bool preview = spec.find_first_not_of("0123456789") == std::string::npos;
+
+    cv::Size patternSize(boardCols, boardRows);
+    std::vector<cv::Point3f> objPoint = BuildObjectPoint(boardRows, boardCols, boardSize);
+    std::vector<std::vector<cv::Point3f>> objPoints;
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    cv::Ptr<CoverageMap> coverage;
+    BackgroundCalibrator calibrator;
+    CalibSnapshot latest;
+    FrameQualitySettings qualitySettings = GetFrameQualitySettings();
+    cv::Mat frame, gray;
+    cv::Size imageSize;
+    std::vector<cv::Point2f> corners;
+    int frameNum = 0, rejectedNum = 0, detectedNum = 0;
+    bool done = false;
+    int64 start = cv::getTickCount();
+    while (!done && (int)imgPoints.size() < AUTO_CAPTURE_MAX && source->Read(frame))
+    {
+        frameNum++;
+        if (!coverage)
+        {
+            imageSize = frame.size();
+            coverage = cv::makePtr<CoverageMap>(imageSize, patternSize);
+        }
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+
+        // the quality checks always run here, the --quality-gate option only sets the thresholds
+        bool kept = false;
+        if (!ScoreFrame(gray, qualitySettings).pass)
+            rejectedNum++;
+        else if (FindChessboard(gray, patternSize, corners))
+        {
+            // scored above already, DetectChessboard would run the gate a second time
+            RefineCorners(gray, corners, patternSize);
+            detectedNum++;
+            if (coverage->Novelty(corners) > 0)
+            {
+                coverage->Add(corners);
+                if (!saveDir.empty())
+                    cv::imwrite(saveDir + std::to_string(imgPoints.size()) + ".jpg", frame);
+                objPoints.push_back(objPoint);
+                imgPoints.push_back(corners);
+                kept = true;
+            }
+        }
+
+        if (kept && imgPoints.size() % AUTO_CAPTURE_INTERVAL == 0)
+            calibrator.Start(objPoints, imgPoints, imageSize, latest.camIntrinsic, latest.camDistort);
+        if (calibrator.Poll(latest))
+        {
+            std::cout << "Views : " << latest.quality.viewNum << ", coverage : " << coverage->Coverage() * 100.0
+                << " %, rms : " << latest.quality.rms << " px, focal std : " << latest.quality.relFocalStd * 100.0
+                << " % (" << latest.quality.verdict << ")" << std::endl;
+            done = MeetsQualityTarget(latest.quality) && coverage->Coverage() >= 0.6;
+        }
+
+        if (preview)
+        {
+            cv::Mat showing;
+            cv::addWeighted(frame, 0.7, coverage->Draw(), 0.3, 0.0, showing);
+            if (kept)
+                cv::drawChessboardCorners(showing, patternSize, corners, true);
+            cv::putText(showing, "views " + std::to_string(imgPoints.size()), cv::Point(20, 40),
+                cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 255, 0), 2);
+            cv::imshow("acquire", showing);
+            if (cv::waitKey(1) == 27) // ESC
+                break;
+        }
+    }
+    calibrator.Wait();
+    calibrator.Poll(latest);
+    double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    std::cout << "Frames : " << frameNum << ", rejected by quality : " << rejectedNum << ", detected : " << detectedNum
+        << ", kept views : " << imgPoints.size() << " (" << elapsed << " s)" << std::endl;
+    if (imgPoints.size() < 3)
+    {
+        std::cout << "[Err] Not enough views to calibrate" << std::endl;
+        return -1;
+    }
+    // the background result may be up to AUTO_CAPTURE_INTERVAL views behind, finish on every kept view
+    // (warm-started from it, so this solve is short)
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    CalibrateWithUncertainty(objPoints, imgPoints, imageSize, latest.camIntrinsic, latest.camDistort, camRotVec, camTransVec,
+        latest.camIntrinsic.empty() ? 0 : cv::CALIB_USE_INTRINSIC_GUESS, latest.quality);
+    std::cout << "===== Acquisition Result =====" << std::endl;
+    PrintCalibQuality(latest.quality);
+    std::cout << "Camera intrinsic parameters :" << std::endl << latest.camIntrinsic << std::endl;
+    std::cout << "Lens distortion coefficients :" << std::endl << latest.camDistort << std::endl;
+    SaveCalibration("camera.xml", latest.camIntrinsic, latest.camDistort, latest.quality);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "Calib_Common.h"
+#include "Calib_Quality.h"
+
+#define BATCH_MEMORY_MB      (1024) // # Budget of the decoded images held by all jobs at once
+
+// One camera of the manifest
+struct CalibJob
+{
+    std::string name;
+    std::string folder;                     // "<folder>N.jpg" like temp\N.jpg
+    int rows = 0, cols = 0;
+    float size = 0.0f;
+    std::string output;
+};
+
+struct CalibJobResult
+{
+    std::string status;                     // done, skipped, failed
+    int imageNum = 0;
+    int viewNum = 0;
+    double ms = 0.0;
+    CalibQuality quality;
+};
+
+// Counting budget of bytes : a job waits before decoding an image when the others hold the whole budget
+class MemoryBudget
+{
+public:
+    explicit MemoryBudget(size_t bytes) : free_(bytes), total_(bytes) {}
+
+    void Acquire(size_t bytes)
+    {
+        bytes = std::min(bytes, total_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return free_ >= bytes; });
+        free_ -= bytes;
+    }
+
+    void Release(size_t bytes)
+    {
+        bytes = std::min(bytes, total_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_ += bytes;
+        }
+        cond_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    size_t free_, total_;
+};
+
+// Read the manifest :
+// jobs:
+//   - { name: cam01, folder: "cam01\\", rows: 7, cols: 10, size: 25, output: "cam01.xml" }
+inline std::vector<CalibJob> LoadJobManifest(const std::string& path)
+{
+    std::vector<CalibJob> jobs;
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        std::cout << "[Err] Failed to open job manifest : " << path << std::endl;
+        return jobs;
+    }
+    cv::FileNode list = fs["jobs"];
+    for (cv::FileNodeIterator it = list.begin(); it != list.end(); ++it)
+    {
+        CalibJob job;
+        (*it)["name"] >> job.name;
+        (*it)["folder"] >> job.folder;
+        (*it)["rows"] >> job.rows;
+        (*it)["cols"] >> job.cols;
+        (*it)["size"] >> job.size;
+        (*it)["output"] >> job.output;
+        if (job.output.empty())
+            job.output = job.name + ".xml";
+        if (job.rows < 2 || job.cols < 2 || job.size <= 0.0f)
+        {
+            std::cout << "[Err] Invalid board geometry of job : " << job.name << std::endl;
+            continue;
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// Calibrate one camera. The images are decoded and detected one by one, so a job holds a single image at a time.
+inline CalibJobResult RunCalibJob(const CalibJob& job, MemoryBudget& budget)
+{
+    CalibJobResult result;
+    if (LoadCalibQuality(job.output, result.quality) && MeetsQualityTarget(result.quality))
+    {
+        result.status = "skipped";
+        return result;
+    }
+
+    int64 tick = cv::getTickCount();
+    cv::Size patternSize(job.cols, job.rows);
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    std::vector<cv::Point2f> corners;
+    cv::Size imageSize;
+    for (int i = 0; i < PATTERN_MAX; i++)
+    {
+        // reserve the size of the previous image(1080p BGR before the first one)
+        size_t bytes = imageSize.area() > 0 ? (size_t)imageSize.area() * 3 : (size_t)1920 * 1080 * 3;
+        budget.Acquire(bytes);
+        cv::Mat src;
+        {
+            PROFILE_STAGE("imread");
+            src = cv::imread(job.folder + std::to_string(i) + ".jpg");
+        }
+        bool found = !src.empty() && DetectChessboard(src, patternSize, corners);
+        bool loaded = !src.empty();
+        if (loaded)
+            imageSize = src.size();
+        src.release();
+        budget.Release(bytes);
+        if (!loaded)
+            break;
+        result.imageNum++;
+        if (found)
+            imgPoints.push_back(corners);
+    }
+
+    result.viewNum = (int)imgPoints.size();
+    if (result.viewNum < 3)
+    {
+        result.status = "failed";
+        result.ms = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+        return result;
+    }
+    std::vector<std::vector<cv::Point3f>> objPoints(imgPoints.size(), BuildObjectPoint(job.rows, job.cols, job.size));
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    CalibrateWithUncertainty(objPoints, imgPoints, imageSize, camIntrinsic, camDistort, camRotVec, camTransVec, 0, result.quality);
+    SaveCalibration(job.output, camIntrinsic, camDistort, result.quality);
+    result.status = "done";
+    result.ms = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+    return result;
+}
+
+// Batch mode : run every job of the manifest on OpenCV's thread pool, without any prompt.
+// The per-job summary goes to batch_result.xml.
+inline int RunBatchCalibration(const std::string& manifest, int memoryMB = BATCH_MEMORY_MB)
+{
+    std::vector<CalibJob> jobs = LoadJobManifest(manifest);
+    if (jobs.empty())
+    {
+        std::cout << "[Err] No job to run in : " << manifest << std::endl;
+        return -1;
+    }
+
+    int jobNum = (int)jobs.size();
+    std::vector<CalibJobResult> results(jobNum);
+    MemoryBudget budget((size_t)memoryMB * 1024 * 1024);
+    std::mutex printMutex;
+    int64 tick = cv::getTickCount();
+    // one stripe per job on the shared pool(nested parallel loops of a job run inline, no oversubscription)
+    cv::parallel_for_(cv::Range(0, jobNum), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            results[i] = RunCalibJob(jobs[i], budget);
+            std::lock_guard<std::mutex> lock(printMutex);
+            std::cout << (results[i].status == "failed" ? "[FAIL] : " : "[PASS] : ") << jobs[i].name << " ("
+                << results[i].status << ", " << results[i].viewNum << "/" << results[i].imageNum << " views, "
+                << results[i].ms << " ms)" << std::endl;
+        }
+    }, jobNum);
+    double elapsed = (cv::getTickCount() - tick) / cv::getTickFrequency();
+
+    int done = 0, skipped = 0, failed = 0;
+    cv::FileStorage fs("batch_result.xml", cv::FileStorage::WRITE);
+    fs << "jobs" << "[";
+    for (int i = 0; i < jobNum; i++)
+    {
+        const CalibJobResult& r = results[i];
+        done += (r.status == "done");
+        skipped += (r.status == "skipped");
+        failed += (r.status == "failed");
+        fs << "{" << "name" << jobs[i].name << "status" << r.status << "output" << jobs[i].output
+            << "images" << r.imageNum << "views" << r.viewNum << "rms" << r.quality.rms
+            << "verdict" << r.quality.verdict << "ms" << r.ms << "}";
+    }
+    fs << "]";
+
+    std::cout << "===== Batch Result =====" << std::endl;
+    std::cout << "Jobs : " << jobNum << ", done : " << done << ", skipped : " << skipped << ", failed : " << failed << std::endl;
+    std::cout << "Elapsed : " << elapsed << " s (" << (elapsed > 0.0 ? done * 3600.0 / elapsed : 0.0) << " cameras/hour)" << std::endl;
+    return failed == 0 ? 0 : -1;
+}
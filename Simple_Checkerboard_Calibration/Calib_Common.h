@@ -0,0 +1,166 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "Stage_Profiler.h"
+#include "SubPix_Refine.h"
+#include "Saddle_Detector.h"
+#include "Frame_Quality.h"
+#include "Detector_Race.h"
+
+#define PATTERN_MAX      (80)   // # Number of the pattern images
+
+enum ChessboardEngine
+{
+    CHESSBOARD_ENGINE_OPENCV = 0,           // cv::findChessboardCorners(quads and contours)
+    CHESSBOARD_ENGINE_SADDLE = 1,           // FindChessboardSaddle(saddle response and grid assembly)
+    CHESSBOARD_ENGINE_RACE = 2              // DetectorRace(flag and preprocessing ladder raced concurrently)
+};
+
+struct ChessboardSettings
+{
+    int engine = CHESSBOARD_ENGINE_OPENCV;
+    SaddleDetectorParams saddle;
+};
+
+inline ChessboardSettings& GetChessboardSettings()
+{
+    static ChessboardSettings settings;
+    return settings;
+}
+
+// Find the inner corners of the checkerboard with the selected engine(no subpixel refinement)
+inline bool FindChessboard(const cv::Mat& image, cv::Size patternSize, std::vector<cv::Point2f>& corners,
+    const ChessboardSettings& settings = GetChessboardSettings())
+{
+    PROFILE_STAGE("findChessboardCorners");
+    if (settings.engine == CHESSBOARD_ENGINE_SADDLE)
+    {
+        cv::Mat gray = image;
+        if (image.channels() != 1)
+            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        return FindChessboardSaddle(gray, patternSize, corners, settings.saddle);
+    }
+    if (settings.engine == CHESSBOARD_ENGINE_RACE)
+    {
+        cv::Mat gray = image;
+        if (image.channels() != 1)
+            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        return GetDetectorRace().Detect(gray, patternSize, corners);
+    }
+    return cv::findChessboardCorners(image, patternSize, corners);
+}
+
+// Ask the rows, columns and size(mm) of checkerboard
+inline void InputBoardGeometry(int& boardRows, int& boardCols, float& boardSize)
+{
+    while (boardRows < 5 && boardCols < 5 && boardSize <= 10.0)
+    {
+        std::cout << "Input the rows, columns and size(mm) of checkerboard(ex : 7 10 25) : ";
+        std::cin >> boardRows >> boardCols >> boardSize;
+    }
+}
+
+// Set the 3D coordinates of checkerboard
+inline std::vector<cv::Point3f> BuildObjectPoint(int boardRows, int boardCols, float boardSize)
+{
+    std::vector<cv::Point3f> objPoint;
+    for (int m = 0; m < boardRows; m++)
+    {
+        for (int n = 0; n < boardCols; n++)
+            objPoint.push_back(cv::Point3f(m * boardSize, n * boardSize, 0.0f));
+    }
+    return objPoint;
+}
+
+// Load "<prefix>0.jpg", "<prefix>1.jpg", ... until the first missing file
+inline std::vector<cv::Mat> LoadPatternImages(const std::string& prefix)
+{
+    std::vector<cv::Mat> images;
+    for (int i = 0; i < PATTERN_MAX; i++)
+    {
+        std::string path = prefix + std::to_string(i) + ".jpg";
+        cv::Mat src;
+        {
+            PROFILE_STAGE("imread");
+            src = cv::imread(path);
+        }
+        if (src.empty())
+        {
+            if (i == 0)
+                std::cout << "[Err] Failed to load source img file : " << path << std::endl;
+            break;
+        }
+        images.push_back(src);
+    }
+    return images;
+}
+
+// Find the checkerboard corners of one image and refine them to subpixel
+inline bool DetectChessboard(const cv::Mat& src, cv::Size patternSize, std::vector<cv::Point2f>& corners)
+{
+    // blurry or badly exposed frames are not worth a full detection
+    if (!PassQualityGate(src))
+    {
+        corners.clear();
+        return false;
+    }
+    cv::Mat srcGray;
+    if (src.channels() == 1)
+        srcGray = src;
+    else
+    {
+        PROFILE_STAGE("cvtColor");
+        cv::cvtColor(src, srcGray, cv::COLOR_BGR2GRAY);
+    }
+
+    bool found = FindChessboard(srcGray, patternSize, corners);
+    PROFILE_COUNT(found ? "boards_found" : "boards_failed", 1);
+    if (!found)
+        return false;
+
+    RefineCorners(srcGray, corners, patternSize);
+    return true;
+}
+
+// Detect the checkerboard on every image in parallel.
+// found[i] is 1 when imgPoints[i] holds the refined corners of image i.
+inline int DetectChessboardViews(const std::vector<cv::Mat>& images, cv::Size patternSize,
+    std::vector<std::vector<cv::Point2f>>& imgPoints, std::vector<uchar>& found)
+{
+    imgPoints.assign(images.size(), std::vector<cv::Point2f>());
+    found.assign(images.size(), 0);
+    cv::parallel_for_(cv::Range(0, (int)images.size()), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; i++)
+            found[i] = DetectChessboard(images[i], patternSize, imgPoints[i]) ? 1 : 0;
+    });
+
+    int foundNum = 0;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        std::cout << (found[i] ? "[PASS] : " : "[FAIL] : ") << i << ".jpg" << std::endl;
+        foundNum += found[i];
+    }
+    return foundNum;
+}
+
+// Keep only the views where the board was found
+inline void KeepFoundViews(std::vector<std::vector<cv::Point2f>>& imgPoints, const std::vector<uchar>& found)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < imgPoints.size(); i++)
+    {
+        if (found[i])
+            imgPoints[n++].swap(imgPoints[i]);
+    }
+    imgPoints.resize(n);
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "Calib_Common.h"
+
+// Compact quality summary of one solve, from the solver's covariance
+struct CalibQuality
+{
+    double rms = 0.0;
+    double stdFx = 0.0, stdFy = 0.0;        // standard deviations(px)
+    double stdCx = 0.0, stdCy = 0.0;
+    double stdK1 = 0.0, stdK2 = 0.0;
+    double relFocalStd = 0.0;               // max(stdFx / fx, stdFy / fy)
+    double worstViewError = 0.0;
+    int worstView = -1;
+    int viewNum = 0;
+    double solveMs = 0.0;
+    std::string verdict;
+};
+
+// Targets of a calibration that is good enough to stop collecting data
+struct CalibQualityTarget
+{
+    double maxRms = 0.5;
+    double maxRelFocalStd = 0.002;
+    double maxCenterStd = 2.0;
+};
+
+inline bool MeetsQualityTarget(const CalibQuality& q, const CalibQualityTarget& target = CalibQualityTarget())
+{
+    return q.viewNum > 0 && q.rms <= target.maxRms && q.relFocalStd <= target.maxRelFocalStd
+        && std::max(q.stdCx, q.stdCy) <= target.maxCenterStd;
+}
+
+// calibrateCamera with the standard deviations of the intrinsics and the per-view errors
+inline double CalibrateWithUncertainty(const std::vector<std::vector<cv::Point3f>>& objPoints,
+    const std::vector<std::vector<cv::Point2f>>& imgPoints, cv::Size imageSize,
+    cv::Mat& camIntrinsic, cv::Mat& camDistort, std::vector<cv::Mat>& camRotVec, std::vector<cv::Mat>& camTransVec,
+    int flags, CalibQuality& quality)
+{
+    PROFILE_STAGE("calibrateCamera");
+    cv::Mat stdIntrinsics, stdExtrinsics, perViewErrors;
+    int64 tick = cv::getTickCount();
+    quality.rms = cv::calibrateCamera(objPoints, imgPoints, imageSize, camIntrinsic, camDistort, camRotVec, camTransVec,
+        stdIntrinsics, stdExtrinsics, perViewErrors, flags);
+    quality.solveMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+    // stdDeviationsIntrinsics : fx, fy, cx, cy, k1, k2, p1, p2, k3, ...
+    const double* s = stdIntrinsics.ptr<double>();
+    quality.stdFx = s[0];
+    quality.stdFy = s[1];
+    quality.stdCx = s[2];
+    quality.stdCy = s[3];
+    quality.stdK1 = s[4];
+    quality.stdK2 = s[5];
+    quality.relFocalStd = std::max(s[0] / camIntrinsic.at<double>(0, 0), s[1] / camIntrinsic.at<double>(1, 1));
+    quality.viewNum = (int)imgPoints.size();
+    quality.worstViewError = 0.0;
+    for (int i = 0; i < (int)perViewErrors.total(); i++)
+    {
+        if (perViewErrors.at<double>(i) > quality.worstViewError)
+        {
+            quality.worstViewError = perViewErrors.at<double>(i);
+            quality.worstView = i;
+        }
+    }
+
+    CalibQualityTarget target;
+    if (MeetsQualityTarget(quality, target))
+        quality.verdict = "GOOD";
+    else if (quality.rms <= target.maxRms * 2.0 && quality.relFocalStd <= target.maxRelFocalStd * 5.0)
+        quality.verdict = "FAIR";
+    else
+        quality.verdict = "POOR";
+    return quality.rms;
+}
+
+inline void PrintCalibQuality(const CalibQuality& q)
+{
+    std::cout << "Quality : " << q.verdict << " (rms " << q.rms << " px, " << q.viewNum << " views)" << std::endl;
+    std::cout << "Std dev fx, fy, cx, cy : " << q.stdFx << ", " << q.stdFy << ", " << q.stdCx << ", " << q.stdCy
+        << " px (focal " << q.relFocalStd * 100.0 << " %)" << std::endl;
+    std::cout << "Std dev k1, k2 : " << q.stdK1 << ", " << q.stdK2 << std::endl;
+    std::cout << "Worst view : " << q.worstView << " (" << q.worstViewError << " px)" << std::endl;
+}
+
+// camera.xml with the quality summary, so a finished job does not have to be run again
+inline void SaveCalibration(const std::string& path, const cv::Mat& camIntrinsic, const cv::Mat& camDistort, const CalibQuality& q)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    fs << "intrinsic" << camIntrinsic;
+    fs << "distortion" << camDistort;
+    fs << "quality" << "{";
+    fs << "verdict" << q.verdict << "rms" << q.rms << "views" << q.viewNum;
+    fs << "std_fx" << q.stdFx << "std_fy" << q.stdFy << "std_cx" << q.stdCx << "std_cy" << q.stdCy;
+    fs << "std_k1" << q.stdK1 << "std_k2" << q.stdK2;
+    fs << "worst_view" << q.worstView << "worst_error" << q.worstViewError;
+    fs << "}";
+}
+
+// Read back the summary of SaveCalibration(false when the file has none)
+inline bool LoadCalibQuality(const std::string& path, CalibQuality& q)
+{
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened() || fs["quality"].empty())
+        return false;
+    cv::FileNode n = fs["quality"];
+    n["verdict"] >> q.verdict;
+    n["rms"] >> q.rms;
+    n["views"] >> q.viewNum;
+    n["std_fx"] >> q.stdFx;
+    n["std_fy"] >> q.stdFy;
+    n["std_cx"] >> q.stdCx;
+    n["std_cy"] >> q.stdCy;
+    n["std_k1"] >> q.stdK1;
+    n["std_k2"] >> q.stdK2;
+    n["worst_view"] >> q.worstView;
+    n["worst_error"] >> q.worstViewError;
+    cv::Mat K;
+    fs["intrinsic"] >> K;
+    if (!K.empty())
+        q.relFocalStd = std::max(q.stdFx / K.at<double>(0, 0), q.stdFy / K.at<double>(1, 1));
+    return true;
+}
+
+// Result of a background calibration
+struct CalibSnapshot
+{
+    cv::Mat camIntrinsic;
+    cv::Mat camDistort;
+    CalibQuality quality;
+    int version = 0;                        // 0 : no calibration yet
+};
+
+// Runs calibrateCamera on a worker thread, so the frame loop never waits for the solver.
+// The views are copied at Start, the loop keeps adding its own while the solve runs.
+class BackgroundCalibrator
+{
+public:
+    ~BackgroundCalibrator()
+    {
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+    bool Busy() const { return busy_; }
+
+    // Start a calibration(warm-started from camIntrinsic, camDistort when given); false while one is running
+    bool Start(const std::vector<std::vector<cv::Point3f>>& objPoints, const std::vector<std::vector<cv::Point2f>>& imgPoints,
+        cv::Size imageSize, const cv::Mat& camIntrinsic = cv::Mat(), const cv::Mat& camDistort = cv::Mat())
+    {
+        if (busy_)
+            return false;
+        if (worker_.joinable())
+            worker_.join();
+        busy_ = true;
+        int version = ++started_;
+        worker_ = std::thread([this, objPoints, imgPoints, imageSize, version,
+            guessK = camIntrinsic.clone(), guessD = camDistort.clone()]() mutable
+        {
+            PROFILE_STAGE("background calibration");
+            CalibSnapshot snapshot;
+            snapshot.camIntrinsic = guessK;
+            snapshot.camDistort = guessD;
+            snapshot.version = version;
+            int flags = guessK.empty() ? 0 : cv::CALIB_USE_INTRINSIC_GUESS;
+            std::vector<cv::Mat> rvecs, tvecs;
+            CalibrateWithUncertainty(objPoints, imgPoints, imageSize, snapshot.camIntrinsic, snapshot.camDistort,
+                rvecs, tvecs, flags, snapshot.quality);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                result_ = snapshot;
+                ready_ = true;
+            }
+            busy_ = false;
+        });
+        return true;
+    }
+
+    // Take the result of the last finished calibration(false when there is no new one)
+    bool Poll(CalibSnapshot& snapshot)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ready_)
+            return false;
+        snapshot = result_;
+        ready_ = false;
+        return true;
+    }
+
+    // Wait for the running calibration
+    void Wait()
+    {
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+private:
+    std::thread worker_;
+    std::atomic<bool> busy_{ false };
+    std::mutex mutex_;
+    CalibSnapshot result_;
+    bool ready_ = false;
+    int started_ = 0;
+};
+
+// Quality mode : solve temp\N.jpg with and without the covariance to measure its overhead.
+// A camera.xml that already meets the quality target is kept unless force is set.
+inline int RunQualityCalibration(int boardRows, int boardCols, float boardSize, bool force = false)
+{
+    CalibQuality saved;
+    if (!force && LoadCalibQuality("camera.xml", saved) && MeetsQualityTarget(saved))
+    {
+        std::cout << "camera.xml already meets the quality target, skipped (quality force to run again)" << std::endl;
+        PrintCalibQuality(saved);
+        return 0;
+    }
+
+    std::vector<cv::Mat> srcImg = LoadPatternImages("temp\\");
+    if (srcImg.empty())
+        return -1;
+    cv::Size patternSize(boardCols, boardRows);
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    std::vector<uchar> found;
+    int foundNum = DetectChessboardViews(srcImg, patternSize, imgPoints, found);
+    KeepFoundViews(imgPoints, found);
+    if (foundNum < 3)
+    {
+        std::cout << "[Err] Not enough views to calibrate" << std::endl;
+        return -1;
+    }
+    std::vector<std::vector<cv::Point3f>> objPoints(foundNum, BuildObjectPoint(boardRows, boardCols, boardSize));
+
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    int64 tick = cv::getTickCount();
+    cv::calibrateCamera(objPoints, imgPoints, srcImg[0].size(), camIntrinsic, camDistort, camRotVec, camTransVec);
+    double plainMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+    CalibQuality quality;
+    CalibrateWithUncertainty(objPoints, imgPoints, srcImg[0].size(), camIntrinsic, camDistort, camRotVec, camTransVec, 0, quality);
+
+    std::cout << "===== Calibration Quality =====" << std::endl;
+    PrintCalibQuality(quality);
+    std::cout << "Solve : " << plainMs << " ms, with covariance : " << quality.solveMs << " ms (overhead "
+        << (quality.solveMs / plainMs - 1.0) * 100.0 << " %)" << std::endl;
+    SaveCalibration("camera.xml", camIntrinsic, camDistort, quality);
+    return 0;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <opencv2/ccalib/omnidir.hpp>
+
+#include "Calib_Common.h"
+
+// Intrinsics of one solve, whatever the camera model
+struct CameraModelResult
+{
+    double rms = 0.0;
+    double solveMs = 0.0;
+    cv::Mat camIntrinsic;                   // 3x3 camera matrix
+    cv::Mat camDistort;                     // distortion coefficients of the model
+    cv::Mat xi;                             // mirror parameter(omnidirectional model only)
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    std::vector<int> usedViews;             // indices of the views the solver really used
+};
+
+// Common interface of the camera models
+class CameraModel
+{
+public:
+    virtual ~CameraModel() {}
+    virtual std::string Name() const = 0;
+    virtual double Calibrate(const std::vector<std::vector<cv::Point3f>>& objPoints,
+        const std::vector<std::vector<cv::Point2f>>& imgPoints, cv::Size imageSize, CameraModelResult& result) = 0;
+    virtual void ProjectPoints(const std::vector<cv::Point3f>& objPoint, const cv::Mat& rvec, const cv::Mat& tvec,
+        const CameraModelResult& result, std::vector<cv::Point2f>& imgPoint) const = 0;
+
+    // Write the result in the same layout as camera.xml
+    virtual void Save(const std::string& path, const CameraModelResult& result) const
+    {
+        cv::FileStorage fs(path, cv::FileStorage::WRITE);
+        fs << "model" << Name();
+        fs << "intrinsic" << result.camIntrinsic;
+        fs << "distortion" << result.camDistort;
+        if (!result.xi.empty())
+            fs << "xi" << result.xi;
+        fs << "rms" << result.rms;
+    }
+};
+
+// Pinhole + k1, k2, p1, p2, k3 (the default of calibrateCamera)
+class PinholeCameraModel : public CameraModel
+{
+public:
+    explicit PinholeCameraModel(int flags = 0) : flags_(flags) {}
+
+    std::string Name() const override { return "pinhole"; }
+
+    double Calibrate(const std::vector<std::vector<cv::Point3f>>& objPoints,
+        const std::vector<std::vector<cv::Point2f>>& imgPoints, cv::Size imageSize, CameraModelResult& result) override
+    {
+        PROFILE_STAGE("calibrateCamera");
+        int64 tick = cv::getTickCount();
+        result.rms = cv::calibrateCamera(objPoints, imgPoints, imageSize, result.camIntrinsic, result.camDistort,
+            result.camRotVec, result.camTransVec, flags_);
+        result.solveMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+        result.usedViews.resize(imgPoints.size());
+        for (size_t i = 0; i < imgPoints.size(); i++)
+            result.usedViews[i] = (int)i;
+        return result.rms;
+    }
+
+    void ProjectPoints(const std::vector<cv::Point3f>& objPoint, const cv::Mat& rvec, const cv::Mat& tvec,
+        const CameraModelResult& result, std::vector<cv::Point2f>& imgPoint) const override
+    {
+        cv::projectPoints(objPoint, rvec, tvec, result.camIntrinsic, result.camDistort, imgPoint);
+    }
+
+protected:
+    int flags_;
+};
+
+// Pinhole + rational k1..k6 for wide lenses that still fit a pinhole projection
+class RationalCameraModel : public PinholeCameraModel
+{
+public:
+    RationalCameraModel() : PinholeCameraModel(cv::CALIB_RATIONAL_MODEL) {}
+
+    std::string Name() const override { return "rational"; }
+};
+
+// Mei's unified omnidirectional model(fisheye and catadioptric)
+class OmnidirCameraModel : public CameraModel
+{
+public:
+    std::string Name() const override { return "omnidir"; }
+
+    double Calibrate(const std::vector<std::vector<cv::Point3f>>& objPoints,
+        const std::vector<std::vector<cv::Point2f>>& imgPoints, cv::Size imageSize, CameraModelResult& result) override
+    {
+        cv::Mat idx;
+        PROFILE_STAGE("omnidir::calibrate");
+        int64 tick = cv::getTickCount();
+        result.rms = cv::omnidir::calibrate(objPoints, imgPoints, imageSize, result.camIntrinsic, result.xi, result.camDistort,
+            result.camRotVec, result.camTransVec, cv::omnidir::CALIB_FIX_SKEW,
+            cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 200, 1e-8), idx);
+        result.solveMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+        // views that fail the initialization are dropped by the solver
+        result.usedViews.clear();
+        if (!idx.empty())
+            result.usedViews.assign(idx.begin<int>(), idx.end<int>());
+        return result.rms;
+    }
+
+    void ProjectPoints(const std::vector<cv::Point3f>& objPoint, const cv::Mat& rvec, const cv::Mat& tvec,
+        const CameraModelResult& result, std::vector<cv::Point2f>& imgPoint) const override
+    {
+        cv::omnidir::projectPoints(objPoint, imgPoint, rvec, tvec, result.camIntrinsic,
+            result.xi.at<double>(0), result.camDistort);
+    }
+};
+
+inline cv::Ptr<CameraModel> CreateCameraModel(const std::string& name)
+{
+    if (name == "pinhole")
+        return cv::makePtr<PinholeCameraModel>();
+    if (name == "rational")
+        return cv::makePtr<RationalCameraModel>();
+    if (name == "omnidir")
+        return cv::makePtr<OmnidirCameraModel>();
+    return cv::Ptr<CameraModel>();
+}
+
+// Model mode : detect once in parallel, then solve with each selected model("all" runs every model)
+inline int RunCameraModelCalibration(int boardRows, int boardCols, float boardSize, const std::string& modelName)
+{
+    std::vector<cv::Mat> srcImg = LoadPatternImages("temp\\");
+    if (srcImg.empty())
+        return -1;
+
+    cv::Size patternSize(boardCols, boardRows);
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    std::vector<uchar> found;
+    int64 tick = cv::getTickCount();
+    int foundNum = DetectChessboardViews(srcImg, patternSize, imgPoints, found);
+    double detectMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+    std::cout << "Detected views : " << foundNum << " / " << srcImg.size() << " (" << detectMs << " ms)" << std::endl;
+    KeepFoundViews(imgPoints, found);
+    if (foundNum < 3)
+    {
+        std::cout << "[Err] Not enough views to calibrate" << std::endl;
+        return -1;
+    }
+    std::vector<std::vector<cv::Point3f>> objPoints(foundNum, BuildObjectPoint(boardRows, boardCols, boardSize));
+
+    std::vector<std::string> names;
+    if (modelName == "all")
+        names = { "pinhole", "rational", "omnidir" };
+    else
+        names.push_back(modelName);
+
+    std::cout << "===== Camera Model Result =====" << std::endl;
+    for (const std::string& name : names)
+    {
+        cv::Ptr<CameraModel> model = CreateCameraModel(name);
+        if (!model)
+        {
+            std::cout << "[Err] Unknown camera model : " << name << std::endl;
+            return -1;
+        }
+        CameraModelResult result;
+        model->Calibrate(objPoints, imgPoints, srcImg[0].size(), result);
+        std::cout << "[" << model->Name() << "] rms : " << result.rms << " px, solve : " << result.solveMs
+            << " ms, views : " << result.usedViews.size() << std::endl;
+        std::cout << "Camera intrinsic parameters :" << std::endl << result.camIntrinsic << std::endl;
+        std::cout << "Lens distortion coefficients :" << std::endl << result.camDistort << std::endl;
+        if (!result.xi.empty())
+            std::cout << "xi : " << result.xi << std::endl;
+        model->Save("camera_" + model->Name() + ".xml", result);
+    }
+    return 0;
+}
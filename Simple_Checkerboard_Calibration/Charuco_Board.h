@@ -0,0 +1,116 @@
+#pragma once
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/aruco/charuco.hpp>
+
+#include "Calib_Common.h"
+
+#define CHARUCO_MIN_CORNERS      (6)    // # Minimum interpolated corners for a view to be used
+
+// ChArUco board with the same inner corner layout as the checkerboard(boardRows x boardCols)
+inline cv::Ptr<cv::aruco::CharucoBoard> CreateCharucoBoard(int boardRows, int boardCols, float boardSize,
+    int dictionaryId = cv::aruco::DICT_6X6_250)
+{
+    cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(dictionaryId);
+    // N inner corners need N + 1 squares, the marker fills 70% of a white square
+    return cv::aruco::CharucoBoard::create(boardCols + 1, boardRows + 1, boardSize, boardSize * 0.7f, dictionary);
+}
+
+// Detect the markers and interpolate the chessboard corners that are visible.
+// Unlike findChessboardCorners, a partially occluded board still gives corners.
+inline int DetectCharuco(const cv::Mat& src, const cv::Ptr<cv::aruco::CharucoBoard>& board,
+    std::vector<cv::Point2f>& charucoCorners, std::vector<int>& charucoIds)
+{
+    cv::Mat srcGray;
+    if (src.channels() == 1)
+        srcGray = src;
+    else
+        cv::cvtColor(src, srcGray, cv::COLOR_BGR2GRAY);
+
+    std::vector<std::vector<cv::Point2f>> markerCorners, rejected;
+    std::vector<int> markerIds;
+    cv::aruco::detectMarkers(srcGray, board->dictionary, markerCorners, markerIds,
+        cv::aruco::DetectorParameters::create(), rejected);
+    charucoCorners.clear();
+    charucoIds.clear();
+    if (markerIds.empty())
+        return 0;
+
+    // recover markers missed by the first pass with the known board layout
+    cv::aruco::refineDetectedMarkers(srcGray, board, markerCorners, markerIds, rejected);
+    // interpolateCornersCharuco already refines the corners to subpixel
+    return cv::aruco::interpolateCornersCharuco(markerCorners, markerIds, srcGray, board, charucoCorners, charucoIds);
+}
+
+// Charuco mode : temp\N.jpg are the pattern images, partial views with enough corners are also used
+inline int RunCharucoCalibration(int boardRows, int boardCols, float boardSize)
+{
+    std::vector<cv::Mat> srcImg = LoadPatternImages("temp\\");
+    if (srcImg.empty())
+        return -1;
+
+    cv::Ptr<cv::aruco::CharucoBoard> board = CreateCharucoBoard(boardRows, boardCols, boardSize);
+    int cornerTotal = boardRows * boardCols;
+    int viewNum = (int)srcImg.size();
+    std::vector<std::vector<cv::Point2f>> corners(viewNum);
+    std::vector<std::vector<int>> ids(viewNum);
+    int64 tick = cv::getTickCount();
+    cv::parallel_for_(cv::Range(0, viewNum), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; i++)
+            DetectCharuco(srcImg[i], board, corners[i], ids[i]);
+    });
+    double detectMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+    std::vector<std::vector<cv::Point2f>> allCorners;
+    std::vector<std::vector<int>> allIds;
+    int fullNum = 0;
+    for (int i = 0; i < viewNum; i++)
+    {
+        int n = (int)ids[i].size();
+        if (n >= CHARUCO_MIN_CORNERS)
+        {
+            std::cout << "[PASS] : " << i << ".jpg (" << n << " / " << cornerTotal << " corners)" << std::endl;
+            allCorners.push_back(corners[i]);
+            allIds.push_back(ids[i]);
+            if (n == cornerTotal)
+                fullNum++;
+        }
+        else
+            std::cout << "[FAIL] : " << i << ".jpg (" << n << " corners)" << std::endl;
+    }
+    int usedNum = (int)allIds.size();
+    std::cout << "Used views : " << usedNum << " / " << viewNum << " (" << usedNum - fullNum
+        << " partial views kept, " << detectMs << " ms)" << std::endl;
+    if (usedNum < 3)
+    {
+        std::cout << "[Err] Not enough views to calibrate" << std::endl;
+        return -1;
+    }
+
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    tick = cv::getTickCount();
+    double rms = cv::aruco::calibrateCameraCharuco(allCorners, allIds, board, srcImg[0].size(), camIntrinsic, camDistort,
+        camRotVec, camTransVec);
+    double solveMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+    std::cout << "===== ChArUco Calibration Result =====" << std::endl;
+    std::cout << "RMS : " << rms << " px (" << solveMs << " ms)" << std::endl;
+    std::cout << "Camera intrinsic parameters :" << std::endl << camIntrinsic << std::endl;
+    std::cout << "Lens distortion coefficients :" << std::endl << camDistort << std::endl;
+
+    cv::FileStorage fs("camera.xml", cv::FileStorage::WRITE);
+    fs << "intrinsic" << camIntrinsic;
+    fs << "distortion" << camDistort;
+    return 0;
+}
+
+// Write a printable image of the board(pixels per square)
+inline void SaveCharucoBoardImage(const std::string& path, int boardRows, int boardCols, int squarePixels = 100)
+{
+    cv::Ptr<cv::aruco::CharucoBoard> board = CreateCharucoBoard(boardRows, boardCols, 1.0f);
+    cv::Mat boardImg;
+    board->draw(cv::Size((boardCols + 1) * squarePixels, (boardRows + 1) * squarePixels), boardImg, squarePixels / 2);
+    cv::imwrite(path, boardImg);
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <set>
+
+#include "Calib_Common.h"
+#include "Calib_Quality.h"
+#include "Frame_Dedup.h"
+#include "Frame_Source.h"
+
+// Incremental coverage of the image plane and of the board poses seen so far
+class CoverageMap
+{
+public:
+    CoverageMap(cv::Size imageSize, cv::Size patternSize, int gridCols = 8, int gridRows = 6)
+        : imageSize_(imageSize), patternSize_(patternSize), grid_(gridRows, gridCols, CV_32S, cv::Scalar(0)) {}
+
+    // Number of new cells and pose bins the view adds(0 : the view repeats what we have)
+    int Novelty(const std::vector<cv::Point2f>& corners) const
+    {
+        int added = 0;
+        for (int c : Cells(corners))
+        {
+            if (grid_.at<int>(c) == 0)
+                added++;
+        }
+        return added + (poseBins_.count(PoseBin(corners)) ? 0 : 1);
+    }
+
+    void Add(const std::vector<cv::Point2f>& corners)
+    {
+        for (int c : Cells(corners))
+            grid_.at<int>(c)++;
+        poseBins_.insert(PoseBin(corners));
+    }
+
+    // Fraction of the cells hit by at least one corner
+    double Coverage() const
+    {
+        return (double)cv::countNonZero(grid_) / grid_.total();
+    }
+
+    int PoseBinCount() const { return (int)poseBins_.size(); }
+
+    // Heat map of the corner counts for display
+    cv::Mat Draw() const
+    {
+        cv::Mat counts, heat;
+        grid_.convertTo(counts, CV_8U, 40.0);
+        cv::resize(counts, counts, imageSize_, 0, 0, cv::INTER_NEAREST);
+        cv::applyColorMap(counts, heat, cv::COLORMAP_JET);
+        return heat;
+    }
+
+private:
+    // Indices of the grid cells hit by the corners
+    std::set<int> Cells(const std::vector<cv::Point2f>& corners) const
+    {
+        std::set<int> cells;
+        for (const cv::Point2f& p : corners)
+        {
+            int cx = std::min(grid_.cols - 1, std::max(0, (int)(p.x * grid_.cols / imageSize_.width)));
+            int cy = std::min(grid_.rows - 1, std::max(0, (int)(p.y * grid_.rows / imageSize_.height)));
+            cells.insert(cy * grid_.cols + cx);
+        }
+        return cells;
+    }
+
+    // Pose bin from the board outline : scale, in-plane angle and the two tilts(edge length ratios)
+    int PoseBin(const std::vector<cv::Point2f>& corners) const
+    {
+        int w = patternSize_.width, h = patternSize_.height;
+        cv::Point2f tl = corners[0], tr = corners[w - 1], bl = corners[(h - 1) * w], br = corners[h * w - 1];
+        double top = cv::norm(tr - tl), bottom = cv::norm(br - bl);
+        double left = cv::norm(bl - tl), right = cv::norm(br - tr);
+        double area = cv::contourArea(std::vector<cv::Point2f>{ tl, tr, br, bl });
+        double scale = std::sqrt(area / imageSize_.area());
+        double angle = std::atan2(tr.y - tl.y, tr.x - tl.x);
+
+        int scaleBin = std::min(3, (int)(scale * 4.0));
+        int angleBin = ((int)std::floor((angle + CV_PI) / (CV_PI / 4.0))) & 7;
+        int tiltX = (top > bottom * 1.1) ? 0 : (bottom > top * 1.1) ? 2 : 1;
+        int tiltY = (left > right * 1.1) ? 0 : (right > left * 1.1) ? 2 : 1;
+        return ((scaleBin * 8 + angleBin) * 3 + tiltX) * 3 + tiltY;
+    }
+
+    cv::Size imageSize_;
+    cv::Size patternSize_;
+    cv::Mat grid_;
+    std::set<int> poseBins_;
+};
+
+// Decides when more views stop improving the intrinsics.
+// Every checkInterval accepted views, a warm-started calibration compares fx, fy, cx, cy with the previous one;
+// it also stops as soon as the standard deviations of the solve meet the quality target.
+class EarlyStopMonitor
+{
+public:
+    EarlyStopMonitor(int checkInterval = 5, double maxRelativeChange = 0.005, int stableChecks = 2, double minCoverage = 0.6)
+        : checkInterval_(checkInterval), maxRelativeChange_(maxRelativeChange), stableChecks_(stableChecks), minCoverage_(minCoverage) {}
+
+    // Returns true when the data collection can stop
+    bool Update(const std::vector<std::vector<cv::Point3f>>& objPoints, const std::vector<std::vector<cv::Point2f>>& imgPoints,
+        cv::Size imageSize, double coverage)
+    {
+        if (imgPoints.size() < 5 || imgPoints.size() % checkInterval_ != 0)
+            return false;
+
+        PROFILE_STAGE("early stop check");
+        int flags = camIntrinsic_.empty() ? 0 : cv::CALIB_USE_INTRINSIC_GUESS;
+        cv::Mat prev = camIntrinsic_.clone();
+        std::vector<cv::Mat> rvecs, tvecs;
+        rms_ = CalibrateWithUncertainty(objPoints, imgPoints, imageSize, camIntrinsic_, camDistort_, rvecs, tvecs, flags, quality_);
+        if (coverage >= minCoverage_ && MeetsQualityTarget(quality_, target_))
+            return true;
+        if (prev.empty())
+            return false;
+
+        change_ = 0.0;
+        const int idx[4][2] = { { 0, 0 }, { 1, 1 }, { 0, 2 }, { 1, 2 } };
+        for (int k = 0; k < 4; k++)
+        {
+            double a = prev.at<double>(idx[k][0], idx[k][1]), b = camIntrinsic_.at<double>(idx[k][0], idx[k][1]);
+            change_ = std::max(change_, std::abs(b - a) / std::max(1.0, std::abs(a)));
+        }
+        stableCount_ = (change_ < maxRelativeChange_) ? stableCount_ + 1 : 0;
+        return stableCount_ >= stableChecks_ && coverage >= minCoverage_;
+    }
+
+    double LastChange() const { return change_; }
+    double LastRms() const { return rms_; }
+    const CalibQuality& Quality() const { return quality_; }
+    const cv::Mat& Intrinsic() const { return camIntrinsic_; }
+    const cv::Mat& Distortion() const { return camDistort_; }
+
+private:
+    int checkInterval_;
+    double maxRelativeChange_;
+    int stableChecks_;
+    double minCoverage_;
+    int stableCount_ = 0;
+    double change_ = 1.0;
+    double rms_ = 0.0;
+    CalibQualityTarget target_;
+    CalibQuality quality_;
+    cv::Mat camIntrinsic_, camDistort_;
+};
+
+// Video mode : read a video file(or a camera index, an image folder), keep the views that add coverage, stop once the intrinsics settle
+inline int RunVideoCalibration(int boardRows, int boardCols, float boardSize, const std::string& source)
+{
+    cv::Ptr<FrameSource> capture = CreateFrameSource(source);
+    if (!capture)
+        return -1;
+
+    cv::Size patternSize(boardCols, boardRows);
+    std::vector<cv::Point3f> objPoint = BuildObjectPoint(boardRows, boardCols, boardSize);
+    std::vector<std::vector<cv::Point3f>> objPoints;
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    cv::Mat frame, gray;
+    cv::Size imageSize;
+    std::vector<cv::Point2f> corners;
+    cv::Ptr<CoverageMap> coverage;
+    EarlyStopMonitor monitor;
+    FrameDeduplicator dedup;
+    bool dedupEnabled = GetFrameDedupSettings().enabled;
+    int frameNum = 0, detectedNum = 0;
+    bool stopped = false;
+    int64 start = cv::getTickCount();
+    while (capture->Read(frame))
+    {
+        frameNum++;
+        if (!coverage)
+        {
+            imageSize = frame.size();
+            coverage = cv::makePtr<CoverageMap>(imageSize, patternSize);
+        }
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        // a still camera repeats the same frame for seconds, skip it before the detection
+        if (dedupEnabled && dedup.IsDuplicate(gray))
+            continue;
+        int64 detectTick = cv::getTickCount();
+        bool found = DetectChessboard(gray, patternSize, corners);
+        dedup.AddDetectTicks(cv::getTickCount() - detectTick);
+        if (!found)
+            continue;
+        detectedNum++;
+        // views that repeat covered cells and poses only slow the solver down
+        if (coverage->Novelty(corners) == 0)
+            continue;
+        coverage->Add(corners);
+        objPoints.push_back(objPoint);
+        imgPoints.push_back(corners);
+        if (monitor.Update(objPoints, imgPoints, imageSize, coverage->Coverage()))
+        {
+            stopped = true;
+            break;
+        }
+    }
+    double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    std::cout << "Frames : " << frameNum << ", detected : " << detectedNum << ", kept views : " << imgPoints.size()
+        << ", coverage : " << (coverage ? coverage->Coverage() * 100.0 : 0.0) << " %, pose bins : "
+        << (coverage ? coverage->PoseBinCount() : 0) << std::endl;
+    std::cout << (stopped ? "Stopped early, intrinsics changed " : "End of source, last intrinsics change ")
+        << monitor.LastChange() * 100.0 << " %, focal std " << monitor.Quality().relFocalStd * 100.0 << " % ("
+        << elapsed << " s)" << std::endl;
+    dedup.PrintStats();
+    if (imgPoints.size() < 3)
+    {
+        std::cout << "[Err] Not enough views to calibrate" << std::endl;
+        return -1;
+    }
+
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    CalibQuality quality;
+    CalibrateWithUncertainty(objPoints, imgPoints, imageSize, camIntrinsic, camDistort, camRotVec, camTransVec, 0, quality);
+    std::cout << "===== Video Calibration Result =====" << std::endl;
+    PrintCalibQuality(quality);
+    std::cout << "Camera intrinsic parameters :" << std::endl << camIntrinsic << std::endl;
+    std::cout << "Lens distortion coefficients :" << std::endl << camDistort << std::endl;
+
+    SaveCalibration("camera.xml", camIntrinsic, camDistort, quality);
+    return 0;
+}
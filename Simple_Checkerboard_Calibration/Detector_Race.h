@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Stage_Profiler.h"
+#include "Saddle_Detector.h"
+
+enum DetectorPreprocess
+{
+    PREPROCESS_NONE = 0,
+    PREPROCESS_EQUALIZE = 1,                // equalizeHist
+    PREPROCESS_CLAHE = 2,                   // local contrast(uneven lighting)
+    PREPROCESS_BLUR = 3                     // gaussian 5x5(sensor noise)
+};
+
+// One rung of the detector ladder : findChessboardCorners flags and preprocessing, or the saddle detector
+struct DetectorConfig
+{
+    std::string name;
+    int flags;
+    int preprocess;
+    bool saddle;
+};
+
+inline std::vector<DetectorConfig> DefaultDetectorLadder()
+{
+    const int base = cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE;
+    std::vector<DetectorConfig> ladder;
+    ladder.push_back({ "default", base, PREPROCESS_NONE, false });
+    ladder.push_back({ "filter_quads", base | cv::CALIB_CB_FILTER_QUADS, PREPROCESS_NONE, false });
+    ladder.push_back({ "adaptive", cv::CALIB_CB_ADAPTIVE_THRESH, PREPROCESS_NONE, false });
+    ladder.push_back({ "equalize", base, PREPROCESS_EQUALIZE, false });
+    ladder.push_back({ "clahe", base | cv::CALIB_CB_FILTER_QUADS, PREPROCESS_CLAHE, false });
+    ladder.push_back({ "blur", base | cv::CALIB_CB_FILTER_QUADS, PREPROCESS_BLUR, false });
+    ladder.push_back({ "saddle", 0, PREPROCESS_NONE, true });
+    return ladder;
+}
+
+// Run one rung on a gray image(no subpixel refinement).
+// stop : checked between the stages, a rung gives up once it is set(findChessboardCorners itself runs to the end)
+inline bool RunDetectorConfig(const DetectorConfig& config, const cv::Mat& gray, cv::Size patternSize, std::vector<cv::Point2f>& corners,
+    const std::atomic<bool>* stop = nullptr)
+{
+    if (config.saddle)
+        return FindChessboardSaddle(gray, patternSize, corners, SaddleDetectorParams(), stop);
+    cv::Mat work;
+    if (config.preprocess == PREPROCESS_EQUALIZE)
+        cv::equalizeHist(gray, work);
+    else if (config.preprocess == PREPROCESS_CLAHE)
+        cv::createCLAHE(2.0, cv::Size(8, 8))->apply(gray, work);
+    else if (config.preprocess == PREPROCESS_BLUR)
+        cv::GaussianBlur(gray, work, cv::Size(5, 5), 0.0);
+    else
+        work = gray;
+    if (stop && *stop)
+        return false;
+    return cv::findChessboardCorners(work, patternSize, corners, config.flags);
+}
+
+// Race the rungs of the ladder on one frame : the first success wins and stops the others at their next stage.
+// The rungs that usually win on this dataset move to the front, so most frames finish with the first race.
+// Each race runs on the OpenCV thread pool and is joined before Detect returns(inside another parallel_for_,
+// like the batch mode, the rungs of a race run one after the other).
+class DetectorRace
+{
+public:
+    explicit DetectorRace(const std::vector<DetectorConfig>& ladder = DefaultDetectorLadder(), int raceWidth = 3)
+        : ladder_(ladder), wins_(ladder.size(), 0), raceWidth_(std::max(1, raceWidth)) {}
+
+    // index : the winning rung(-1 when every rung failed)
+    bool Detect(const cv::Mat& gray, cv::Size patternSize, std::vector<cv::Point2f>& corners, int* index = nullptr)
+    {
+        PROFILE_STAGE("detector race");
+        std::vector<int> order = Order();
+        for (size_t first = 0; first < order.size(); first += raceWidth_)
+        {
+            int last = (int)std::min(order.size(), first + raceWidth_);
+            RaceState state;
+            cv::parallel_for_(cv::Range((int)first, last), [&](const cv::Range& range)
+            {
+                for (int k = range.start; k < range.end; k++)
+                {
+                    std::vector<cv::Point2f> found;
+                    if (state.stop || !RunDetectorConfig(ladder_[order[k]], gray, patternSize, found, &state.stop))
+                        continue;
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    if (state.winner < 0)
+                    {
+                        state.winner = order[k];
+                        state.corners.swap(found);
+                        state.stop = true;
+                    }
+                }
+            }, last - (int)first);
+
+            if (state.winner >= 0)
+            {
+                corners.swap(state.corners);
+                RecordResult(state.winner);
+                if (index)
+                    *index = state.winner;
+                return true;
+            }
+        }
+        RecordResult(-1);
+        if (index)
+            *index = -1;
+        corners.clear();
+        return false;
+    }
+
+    // Rung indices, most wins first(ladder order on ties)
+    std::vector<int> Order() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<int> order(ladder_.size());
+        for (size_t k = 0; k < order.size(); k++)
+            order[k] = (int)k;
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return wins_[a] > wins_[b]; });
+        return order;
+    }
+
+    const std::vector<DetectorConfig>& Ladder() const { return ladder_; }
+
+    // The learned win counts of one dataset
+    bool Load(const std::string& path)
+    {
+        cv::FileStorage fs(path, cv::FileStorage::READ);
+        if (!fs.isOpened())
+            return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t k = 0; k < ladder_.size(); k++)
+        {
+            if (!fs[ladder_[k].name].empty())
+                fs[ladder_[k].name] >> wins_[k];
+        }
+        return true;
+    }
+
+    void Save(const std::string& path) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv::FileStorage fs(path, cv::FileStorage::WRITE);
+        for (size_t k = 0; k < ladder_.size(); k++)
+            fs << ladder_[k].name << wins_[k];
+    }
+
+    void PrintStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (races_ == 0)
+            return;
+        std::cout << "===== Detector Race =====" << std::endl;
+        std::cout << "Frames : " << races_ << ", failed : " << failed_ << std::endl;
+        for (size_t k = 0; k < ladder_.size(); k++)
+            std::cout << ladder_[k].name << " : " << wins_[k] << " wins" << std::endl;
+    }
+
+private:
+    struct RaceState
+    {
+        std::mutex mutex;
+        std::atomic<bool> stop{ false };
+        int winner = -1;
+        std::vector<cv::Point2f> corners;
+    };
+
+    void RecordResult(int winner)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        races_++;
+        if (winner >= 0)
+            wins_[winner]++;
+        else
+            failed_++;
+    }
+
+    std::vector<DetectorConfig> ladder_;
+    std::vector<int> wins_;
+    int raceWidth_;
+    int races_ = 0;
+    int failed_ = 0;
+    mutable std::mutex mutex_;
+};
+
+inline DetectorRace& GetDetectorRace()
+{
+    static DetectorRace race;
+    return race;
+}
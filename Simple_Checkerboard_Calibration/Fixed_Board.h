@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+
+#include "Calib_Common.h"
+
+// Check that the corners form a regular grid : every step along a row is within [0.5, 2] x the mean row step,
+// and every step down a column within [0.5, 2] x the mean column step(each axis on its own, so a strongly
+// foreshortened board still passes). Rows, Cols given as template arguments make the loop bounds constants.
+template<int Rows = 0, int Cols = 0>
+inline bool ValidateCornerGrid(const cv::Point2f* corners, int runtimeRows = Rows, int runtimeCols = Cols)
+{
+    const int rows = Rows ? Rows : runtimeRows;
+    const int cols = Cols ? Cols : runtimeCols;
+    if (rows < 2 || cols < 2)
+        return false;
+    double rowSum = 0.0, colSum = 0.0;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const cv::Point2f& p = corners[r * cols + c];
+            if (c + 1 < cols)
+                rowSum += cv::norm(corners[r * cols + c + 1] - p);
+            if (r + 1 < rows)
+                colSum += cv::norm(corners[(r + 1) * cols + c] - p);
+        }
+    }
+    double rowMean = rowSum / (rows * (cols - 1)), colMean = colSum / ((rows - 1) * cols);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const cv::Point2f& p = corners[r * cols + c];
+            double right = (c + 1 < cols) ? cv::norm(corners[r * cols + c + 1] - p) : rowMean;
+            double down = (r + 1 < rows) ? cv::norm(corners[(r + 1) * cols + c] - p) : colMean;
+            if (right < rowMean * 0.5 || right > rowMean * 2.0 || down < colMean * 0.5 || down > colMean * 2.0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Board pose per frame : detection, grid validation, pose and reprojection RMS
+class BoardPoseEngine
+{
+public:
+    virtual ~BoardPoseEngine() {}
+    virtual std::string Name() const = 0;
+    virtual bool Detect(const cv::Mat& gray) = 0;
+    // Corners found elsewhere(pyramid detection, optical flow), validated like a detection
+    virtual bool SetCorners(const std::vector<cv::Point2f>& corners) = 0;
+    // corners keeps its storage when the size does not change
+    virtual void GetCorners(std::vector<cv::Point2f>& corners) const = 0;
+    // rvec, tvec are 3x1 CV_64F, used as the initial guess when useGuess is set
+    virtual double Pose(const cv::Mat& camIntrinsic, const cv::Mat& camDistort, cv::Mat& rvec, cv::Mat& tvec, bool useGuess) = 0;
+};
+
+// Board geometry known at compile time(Rows x Cols inner corners) : corner and object point storage are
+// fixed-size arrays inside the engine, and every loop over the board has constant bounds.
+template<int Rows, int Cols>
+class FixedBoardEngine : public BoardPoseEngine
+{
+public:
+    enum { kCorners = Rows * Cols };
+
+    explicit FixedBoardEngine(float boardSize)
+    {
+        for (int m = 0; m < Rows; m++)
+        {
+            for (int n = 0; n < Cols; n++)
+                objPoint_[m * Cols + n] = cv::Point3f(m * boardSize, n * boardSize, 0.0f);
+        }
+        found_.reserve(kCorners);
+    }
+
+    std::string Name() const override { return "fixed " + std::to_string(Rows) + "x" + std::to_string(Cols); }
+
+    bool Detect(const cv::Mat& gray) override
+    {
+        // the detector may return a partial set, so it writes to a reserved vector first
+        if (!FindChessboard(gray, cv::Size(Cols, Rows), found_) || (int)found_.size() != kCorners)
+            return false;
+        std::copy(found_.begin(), found_.end(), corners_.begin());
+        return ValidateCornerGrid<Rows, Cols>(corners_.data());
+    }
+
+    bool SetCorners(const std::vector<cv::Point2f>& corners) override
+    {
+        if ((int)corners.size() != kCorners)
+            return false;
+        std::copy(corners.begin(), corners.end(), corners_.begin());
+        return ValidateCornerGrid<Rows, Cols>(corners_.data());
+    }
+
+    void GetCorners(std::vector<cv::Point2f>& corners) const override
+    {
+        corners.assign(corners_.begin(), corners_.end());
+    }
+
+    double Pose(const cv::Mat& camIntrinsic, const cv::Mat& camDistort, cv::Mat& rvec, cv::Mat& tvec, bool useGuess) override
+    {
+        cv::solvePnP(objPoint_, corners_, camIntrinsic, camDistort, rvec, tvec, useGuess, cv::SOLVEPNP_ITERATIVE);
+        cv::projectPoints(objPoint_, rvec, tvec, camIntrinsic, camDistort, reprojected_);
+        double err = 0.0;
+        for (int k = 0; k < kCorners; k++)
+        {
+            cv::Point2f d = corners_[k] - reprojected_[k];
+            err += d.x * d.x + d.y * d.y;
+        }
+        return std::sqrt(err / kCorners);
+    }
+
+    const std::array<cv::Point2f, kCorners>& Corners() const { return corners_; }
+
+private:
+    std::array<cv::Point3f, kCorners> objPoint_;
+    std::array<cv::Point2f, kCorners> corners_;
+    std::array<cv::Point2f, kCorners> reprojected_;
+    std::vector<cv::Point2f> found_;
+};
+
+// Runtime fallback for any board : the same steps on vectors sized at construction
+class DynamicBoardEngine : public BoardPoseEngine
+{
+public:
+    DynamicBoardEngine(int boardRows, int boardCols, float boardSize)
+        : rows_(boardRows), cols_(boardCols), objPoint_(BuildObjectPoint(boardRows, boardCols, boardSize))
+    {
+        corners_.reserve(objPoint_.size());
+        reprojected_.reserve(objPoint_.size());
+    }
+
+    std::string Name() const override { return "dynamic " + std::to_string(rows_) + "x" + std::to_string(cols_); }
+
+    bool Detect(const cv::Mat& gray) override
+    {
+        if (!FindChessboard(gray, cv::Size(cols_, rows_), corners_) || corners_.size() != objPoint_.size())
+            return false;
+        return ValidateCornerGrid<>(corners_.data(), rows_, cols_);
+    }
+
+    bool SetCorners(const std::vector<cv::Point2f>& corners) override
+    {
+        if (corners.size() != objPoint_.size())
+            return false;
+        corners_.assign(corners.begin(), corners.end());
+        return ValidateCornerGrid<>(corners_.data(), rows_, cols_);
+    }
+
+    void GetCorners(std::vector<cv::Point2f>& corners) const override
+    {
+        corners.assign(corners_.begin(), corners_.end());
+    }
+
+    double Pose(const cv::Mat& camIntrinsic, const cv::Mat& camDistort, cv::Mat& rvec, cv::Mat& tvec, bool useGuess) override
+    {
+        cv::solvePnP(objPoint_, corners_, camIntrinsic, camDistort, rvec, tvec, useGuess, cv::SOLVEPNP_ITERATIVE);
+        cv::projectPoints(objPoint_, rvec, tvec, camIntrinsic, camDistort, reprojected_);
+        double err = 0.0;
+        for (size_t k = 0; k < corners_.size(); k++)
+        {
+            cv::Point2f d = corners_[k] - reprojected_[k];
+            err += d.x * d.x + d.y * d.y;
+        }
+        return std::sqrt(err / corners_.size());
+    }
+
+private:
+    int rows_, cols_;
+    std::vector<cv::Point3f> objPoint_;
+    std::vector<cv::Point2f> corners_;
+    std::vector<cv::Point2f> reprojected_;
+};
+
+// Fixed engine for the production targets, dynamic engine for any other board
+inline cv::Ptr<BoardPoseEngine> CreateBoardPoseEngine(int boardRows, int boardCols, float boardSize)
+{
+    if (boardRows == 7 && boardCols == 10)
+        return cv::makePtr<FixedBoardEngine<7, 10>>(boardSize);
+    if (boardRows == 6 && boardCols == 9)
+        return cv::makePtr<FixedBoardEngine<6, 9>>(boardSize);
+    if (boardRows == 9 && boardCols == 6)
+        return cv::makePtr<FixedBoardEngine<9, 6>>(boardSize);
+    if (boardRows == 8 && boardCols == 11)
+        return cv::makePtr<FixedBoardEngine<8, 11>>(boardSize);
+    return cv::makePtr<DynamicBoardEngine>(boardRows, boardCols, boardSize);
+}
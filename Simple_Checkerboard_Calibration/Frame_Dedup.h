@@ -0,0 +1,93 @@
+#pragma once
+
+#include <deque>
+#include <iostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/img_hash.hpp>
+
+#include "Stage_Profiler.h"
+
+// Near-duplicate test of the dedup stage
+struct FrameDedupSettings
+{
+    bool enabled = false;
+    int hashWidth = 160;                    // the frame is scaled to this width before hashing
+    double maxDistance = 4.0;               // hamming distance of the 64 bit pHash(<= : duplicate)
+    int history = 8;                        // kept frames compared with each new frame
+};
+
+inline FrameDedupSettings& GetFrameDedupSettings()
+{
+    static FrameDedupSettings settings;
+    return settings;
+}
+
+// Skip frames whose perceptual hash is close to one of the recently kept frames
+class FrameDeduplicator
+{
+public:
+    explicit FrameDeduplicator(const FrameDedupSettings& settings = GetFrameDedupSettings())
+        : settings_(settings), hasher_(cv::img_hash::PHash::create()) {}
+
+    // True when the frame repeats a kept frame(the frame is kept otherwise)
+    bool IsDuplicate(const cv::Mat& image)
+    {
+        PROFILE_STAGE("dedup hash");
+        int64 tick = cv::getTickCount();
+        cv::Mat small, hash;
+        double s = (double)settings_.hashWidth / image.cols;
+        cv::resize(image, small, cv::Size(), s, s, cv::INTER_AREA);
+        hasher_->compute(small, hash);
+
+        bool duplicate = false;
+        for (const cv::Mat& kept : hashes_)
+        {
+            if (hasher_->compare(hash, kept) <= settings_.maxDistance)
+            {
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate)
+        {
+            hashes_.push_back(hash);
+            if ((int)hashes_.size() > settings_.history)
+                hashes_.pop_front();
+        }
+        hashed_++;
+        skipped_ += duplicate;
+        hashTicks_ += cv::getTickCount() - tick;
+        return duplicate;
+    }
+
+    // Time of one detection on a kept frame, to estimate the time the skipped frames saved
+    void AddDetectTicks(int64 ticks)
+    {
+        detected_++;
+        detectTicks_ += ticks;
+    }
+
+    void PrintStats() const
+    {
+        if (hashed_ == 0)
+            return;
+        double hashMs = hashTicks_ * 1000.0 / cv::getTickFrequency();
+        double detectMs = detected_ > 0 ? detectTicks_ * 1000.0 / cv::getTickFrequency() / detected_ : 0.0;
+        std::cout << "===== Frame Dedup =====" << std::endl;
+        std::cout << "Hashed : " << hashed_ << ", skipped : " << skipped_ << " (" << skipped_ * 100.0 / hashed_ << " %)" << std::endl;
+        std::cout << "Hash time : " << hashMs / hashed_ << " ms/frame, saved detection time : "
+            << skipped_ * detectMs - hashMs << " ms (" << detectMs << " ms/detection)" << std::endl;
+    }
+
+private:
+    FrameDedupSettings settings_;
+    cv::Ptr<cv::img_hash::PHash> hasher_;
+    std::deque<cv::Mat> hashes_;
+    int hashed_ = 0;
+    int skipped_ = 0;
+    int detected_ = 0;
+    int64 hashTicks_ = 0;
+    int64 detectTicks_ = 0;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Stage_Profiler.h"
+
+// Thresholds of the quality gate, measured on the image scaled to scoreWidth
+struct FrameQualitySettings
+{
+    bool enabled = false;
+    int scoreWidth = 640;
+    double minSharpness = 50.0;             // variance of the Laplacian
+    double maxSaturated = 0.05;             // fraction of pixels >= 250
+    double maxDark = 0.60;                  // fraction of pixels <= 5
+};
+
+struct FrameQuality
+{
+    double sharpness = 0.0;
+    double saturated = 0.0;
+    double dark = 0.0;
+    bool pass = true;
+    const char* reason = "";
+};
+
+// Counters of the gate, shared by the detection threads
+struct FrameQualityStats
+{
+    std::atomic<int> scored{ 0 };
+    std::atomic<int> rejectedBlur{ 0 };
+    std::atomic<int> rejectedExposure{ 0 };
+    std::atomic<int64> scoreTicks{ 0 };
+};
+
+inline FrameQualitySettings& GetFrameQualitySettings()
+{
+    static FrameQualitySettings settings;
+    return settings;
+}
+
+inline FrameQualityStats& GetFrameQualityStats()
+{
+    static FrameQualityStats stats;
+    return stats;
+}
+
+// Score one frame on a downsampled copy(a few 100 us for a 1080p frame)
+inline FrameQuality ScoreFrame(const cv::Mat& image, const FrameQualitySettings& settings = GetFrameQualitySettings())
+{
+    PROFILE_STAGE("quality score");
+    int64 tick = cv::getTickCount();
+    cv::Mat gray = image, small;
+    if (image.channels() != 1)
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    if (gray.cols > settings.scoreWidth)
+    {
+        double s = (double)settings.scoreWidth / gray.cols;
+        cv::resize(gray, small, cv::Size(), s, s, cv::INTER_AREA);
+    }
+    else
+        small = gray;
+
+    FrameQuality q;
+    cv::Mat lap;
+    cv::Laplacian(small, lap, CV_16S);
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(lap, mean, stddev);
+    q.sharpness = stddev[0] * stddev[0];
+    double total = (double)small.total();
+    q.saturated = cv::countNonZero(small >= 250) / total;
+    q.dark = cv::countNonZero(small <= 5) / total;
+
+    FrameQualityStats& stats = GetFrameQualityStats();
+    if (q.sharpness < settings.minSharpness)
+    {
+        q.pass = false;
+        q.reason = "blur";
+        stats.rejectedBlur++;
+    }
+    else if (q.saturated > settings.maxSaturated || q.dark > settings.maxDark)
+    {
+        q.pass = false;
+        q.reason = "exposure";
+        stats.rejectedExposure++;
+    }
+    stats.scored++;
+    stats.scoreTicks += cv::getTickCount() - tick;
+    return q;
+}
+
+// True when the gate is off or the frame passes it
+inline bool PassQualityGate(const cv::Mat& image)
+{
+    if (!GetFrameQualitySettings().enabled)
+        return true;
+    return ScoreFrame(image).pass;
+}
+
+inline void PrintFrameQualityStats()
+{
+    FrameQualityStats& stats = GetFrameQualityStats();
+    int scored = stats.scored;
+    if (scored == 0)
+        return;
+    double ms = stats.scoreTicks * 1000.0 / cv::getTickFrequency();
+    std::cout << "===== Quality Gate =====" << std::endl;
+    std::cout << "Scored : " << scored << ", rejected blur : " << stats.rejectedBlur
+        << ", rejected exposure : " << stats.rejectedExposure << std::endl;
+    std::cout << "Score time : " << ms / scored << " ms/frame (" << scored * 1000.0 / ms << " frames/s)" << std::endl;
+}
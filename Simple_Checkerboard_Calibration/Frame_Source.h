@@ -0,0 +1,270 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <utility>
+
+#include <opencv2/videoio.hpp>
+
+#include "Calib_Common.h"
+
+#define REPLAY_MAX_MB (512)          // # Memory for the recorded frames of a replay(--replay-mb=)
+
+// Where the frames of the live loop and the video mode come from.
+// timestampMs is the capture time of the frame, measured from the first frame.
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+    virtual std::string Name() const = 0;
+    virtual bool IsOpened() const = 0;
+    virtual bool Read(cv::Mat& frame, double& timestampMs) = 0;
+
+    bool Read(cv::Mat& frame)
+    {
+        double timestampMs;
+        return Read(frame, timestampMs);
+    }
+};
+
+// Time since the first call(ms)
+class FrameClock
+{
+public:
+    double Now()
+    {
+        int64 tick = cv::getTickCount();
+        if (start_ == 0)
+            start_ = tick;
+        return (tick - start_) * 1000.0 / cv::getTickFrequency();
+    }
+
+    void Reset() { start_ = 0; }
+
+private:
+    int64 start_ = 0;
+};
+
+// USB camera, MJPG at 1920x1080 like the original live loop
+class CameraFrameSource : public FrameSource
+{
+public:
+    explicit CameraFrameSource(int index, cv::Size size = cv::Size(1920, 1080)) : index_(index)
+    {
+        capture_.open(index);
+        capture_.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
+        capture_.set(cv::CAP_PROP_FRAME_WIDTH, size.width);
+        capture_.set(cv::CAP_PROP_FRAME_HEIGHT, size.height);
+    }
+
+    std::string Name() const override { return "camera " + std::to_string(index_); }
+    bool IsOpened() const override { return capture_.isOpened(); }
+
+    bool Read(cv::Mat& frame, double& timestampMs) override
+    {
+        if (!capture_.read(frame))
+            return false;
+        timestampMs = clock_.Now();
+        return true;
+    }
+
+private:
+    int index_;
+    cv::VideoCapture capture_;
+    FrameClock clock_;
+};
+
+// Video file, timestamps from the container
+class VideoFileFrameSource : public FrameSource
+{
+public:
+    explicit VideoFileFrameSource(const std::string& path) : path_(path), capture_(path) {}
+
+    std::string Name() const override { return path_; }
+    bool IsOpened() const override { return capture_.isOpened(); }
+
+    bool Read(cv::Mat& frame, double& timestampMs) override
+    {
+        if (!capture_.read(frame))
+            return false;
+        timestampMs = capture_.get(cv::CAP_PROP_POS_MSEC);
+        return true;
+    }
+
+private:
+    std::string path_;
+    cv::VideoCapture capture_;
+};
+
+// "<prefix>0.jpg", "<prefix>1.jpg", ... decoded on demand, timestamps at fps
+class ImageFolderFrameSource : public FrameSource
+{
+public:
+    ImageFolderFrameSource(const std::string& prefix, double fps = 30.0) : prefix_(prefix), fps_(fps)
+    {
+        std::ifstream first(prefix_ + "0.jpg");
+        opened_ = first.good();
+    }
+
+    std::string Name() const override { return prefix_; }
+    bool IsOpened() const override { return opened_; }
+
+    bool Read(cv::Mat& frame, double& timestampMs) override
+    {
+        if (index_ >= PATTERN_MAX)
+            return false;
+        frame = cv::imread(prefix_ + std::to_string(index_) + ".jpg");
+        if (frame.empty())
+            return false;
+        timestampMs = index_ * 1000.0 / fps_;
+        index_++;
+        return true;
+    }
+
+private:
+    std::string prefix_;
+    double fps_;
+    int index_ = 0;
+    bool opened_ = false;
+};
+
+// Frames held in memory, played loops times with timestamps at fps.
+// Nothing is decoded while reading, so the live loop is measured alone.
+class RingFrameSource : public FrameSource
+{
+public:
+    RingFrameSource(std::vector<cv::Mat> frames, double fps = 30.0, int loops = 1)
+        : frames_(std::move(frames)), fps_(fps), loops_(loops) {}
+
+    std::string Name() const override { return "ring(" + std::to_string(frames_.size()) + " frames)"; }
+    bool IsOpened() const override { return !frames_.empty(); }
+
+    bool Read(cv::Mat& frame, double& timestampMs) override
+    {
+        if (frames_.empty() || index_ >= Length())
+            return false;
+        // the caller may draw on the frame, the ring keeps the original
+        frames_[index_ % frames_.size()].copyTo(frame);
+        timestampMs = index_ * 1000.0 / fps_;
+        index_++;
+        return true;
+    }
+
+    // Play loops times again from the first frame
+    void Rewind(int loops)
+    {
+        loops_ = loops;
+        index_ = 0;
+    }
+
+    // Index of the next frame over all the loops, Seek skips the frames before it
+    int64 Position() const { return index_; }
+    void Seek(int64 index) { index_ = index; }
+    int64 Length() const { return (int64)frames_.size() * loops_; }
+    int FrameCount() const { return (int)frames_.size(); }
+
+private:
+    std::vector<cv::Mat> frames_;
+    double fps_;
+    int loops_;
+    int64 index_ = 0;
+};
+
+// Deterministic replay : the frames of any source are recorded into memory(up to maxMB) and fed back at rate fps
+// from a RingFrameSource. Paced, Read waits for the arrival time of each frame like a camera, and drops the frames
+// the caller was too late for; unpaced, the frames come as fast as the caller reads them(throughput).
+class ReplayFrameSource : public FrameSource
+{
+public:
+    ReplayFrameSource(FrameSource& recorded, double fps, bool paced, int loops = 1, double maxMB = REPLAY_MAX_MB)
+        : fps_(fps), paced_(paced)
+    {
+        // a 1080p BGR frame is about 6 MB : the budget bounds the recording, not a frame count
+        double budget = maxMB * 1024.0 * 1024.0, bytes = 0.0;
+        std::vector<cv::Mat> frames;
+        cv::Mat frame;
+        while (recorded.Read(frame))
+        {
+            bytes += (double)frame.total() * frame.elemSize();
+            if (bytes > budget)
+            {
+                truncated_ = true;
+                break;
+            }
+            frames.push_back(frame.clone());
+        }
+        ring_ = cv::makePtr<RingFrameSource>(std::move(frames), fps, loops);
+        name_ = "replay " + recorded.Name();
+    }
+
+    std::string Name() const override { return name_; }
+    bool IsOpened() const override { return ring_->IsOpened(); }
+
+    bool Read(cv::Mat& frame, double& timestampMs) override
+    {
+        if (paced_)
+        {
+            // a camera does not wait : the frames that arrived while the caller was busy are gone
+            double periodMs = 1000.0 / fps_;
+            double now = clock_.Now();
+            int64 due = (int64)(now / periodMs);
+            int64 index = ring_->Position();
+            if (due > index)
+            {
+                dropped_ += (int)(due - index);
+                index = due;
+                ring_->Seek(index);
+            }
+            if (index >= ring_->Length())
+                return false;
+            double wait = index * periodMs - now;
+            if (wait > 0.0)
+                std::this_thread::sleep_for(std::chrono::microseconds((int64)(wait * 1000.0)));
+        }
+        return ring_->Read(frame, timestampMs);
+    }
+
+    // Play the recording loops times again from the first frame
+    void Rewind(bool paced, int loops = 1)
+    {
+        paced_ = paced;
+        ring_->Rewind(loops);
+        dropped_ = 0;
+        clock_.Reset();
+    }
+
+    // Time since the start of the replay(ms), on the clock of the timestamps
+    double Now() { return clock_.Now(); }
+    int Dropped() const { return dropped_; }
+    int FrameCount() const { return ring_->FrameCount(); }
+    // True when the source had more frames than the memory budget
+    bool Truncated() const { return truncated_; }
+
+private:
+    cv::Ptr<RingFrameSource> ring_;
+    std::string name_;
+    double fps_;
+    bool paced_;
+    int dropped_ = 0;
+    bool truncated_ = false;
+    FrameClock clock_;
+};
+
+// Source from a spec : camera index("0"), image folder(ends with \ or /) or video file
+inline cv::Ptr<FrameSource> CreateFrameSource(const std::string& spec)
+{
+    cv::Ptr<FrameSource> source;
+    if (!spec.empty() && spec.find_first_not_of("0123456789") == std::string::npos)
+        source = cv::makePtr<CameraFrameSource>(std::stoi(spec));
+    else if (!spec.empty() && (spec.back() == '\\' || spec.back() == '/'))
+        source = cv::makePtr<ImageFolderFrameSource>(spec);
+    else
+        source = cv::makePtr<VideoFileFrameSource>(spec);
+    if (!source->IsOpened())
+    {
+        std::cout << "[Err] Failed to open frame source : " << spec << std::endl;
+        return cv::Ptr<FrameSource>();
+    }
+    return source;
+}
@@ -0,0 +1,503 @@
+#pragma once
+
+#include <opencv2/video/tracking.hpp>
+
+#include <deque>
+#include <limits>
+#include <memory>
+
+#include "Calib_Common.h"
+#include "Calib_Quality.h"
+#include "Fixed_Board.h"
+#include "Frame_Source.h"
+#include "Planar_Pose.h"
+#include "Projection_Kernels.h"
+
+#define LIVE_TRACK_KEYFRAME  (30)   // # Tracked frames between two detections in the track mode
+#define DRIFT_MIN_VIEWS      (10)   // # Recent views needed for a recalibration
+#define DRIFT_MAX_VIEWS      (30)   // # Recent views kept for a recalibration
+#define DRIFT_VIEW_MOVE      (20.0) // # Mean corner motion(px) between two kept views
+#define DRIFT_HOLDOUT_EVERY  (4)    // # Every n-th recent view is held out of the recalibration to score it
+
+// Intrinsics in use by the live loop, with the projection kernel selected for their distortion model
+struct LiveIntrinsics
+{
+    cv::Mat camIntrinsic;
+    cv::Mat camDistort;
+    PointProjector projector;
+    int version = 0;
+};
+
+enum LiveMode
+{
+    LIVE_MODE_FULL = 0,                     // detection on the full resolution frame
+    LIVE_MODE_PYRAMID = 1,                  // detection on the pyrDown frame, corners refined on the full one
+    LIVE_MODE_TRACK = 2                     // optical flow of the last corners(detection when the track is lost)
+};
+
+// Board pose of the live loop on buffers allocated once.
+// gray, corners, the pose and the projected axis keep their storage from frame to frame,
+// and once a pose is known solvePnP refines it in place instead of a new RANSAC run(--pnp=planar : IPPE instead).
+// Detection, grid validation and the pose refinement go through the board engine(fixed size for the production boards).
+class LivePoseTracker
+{
+public:
+    LivePoseTracker(int boardRows, int boardCols, float boardSize, const cv::Mat& camIntrinsic, const cv::Mat& camDistort,
+        float axisLength = 30.0f)
+        : patternSize_(boardCols, boardRows), objPoint_(BuildObjectPoint(boardRows, boardCols, boardSize)),
+        engine_(CreateBoardPoseEngine(boardRows, boardCols, boardSize)),
+        rvec_(3, 1, CV_64F, cv::Scalar(0)), tvec_(3, 1, CV_64F, cv::Scalar(0))
+    {
+        SetIntrinsics(camIntrinsic, camDistort);
+        corners_.reserve(patternSize_.area());
+        tracked_.reserve(patternSize_.area());
+        status_.reserve(patternSize_.area());
+        trackErr_.reserve(patternSize_.area());
+        projected_.reserve(3);
+        axis_.push_back(cv::Point3f(axisLength, 0, 0));
+        axis_.push_back(cv::Point3f(0, axisLength, 0));
+        axis_.push_back(cv::Point3f(0, 0, axisLength));
+    }
+
+    // Find the board and its pose on one frame(BGR or gray). The axis is in Projected() when it returns true.
+    bool Process(const cv::Mat& frame, int mode = LIVE_MODE_FULL)
+    {
+        if (frame.channels() == 1)
+            frame.copyTo(gray_);
+        else
+        {
+            PROFILE_STAGE("cvtColor");
+            cv::cvtColor(frame, gray_, cv::COLOR_BGR2GRAY);
+        }
+
+        // one snapshot per frame : a swap from another thread takes effect on the next frame
+        std::shared_ptr<const LiveIntrinsics> cam = std::atomic_load(&intrinsics_);
+        bool found = false;
+        lastMode_ = mode;
+        // a fresh detection every LIVE_TRACK_KEYFRAME frames keeps the track from drifting
+        if (mode == LIVE_MODE_TRACK && hasPose_ && ++trackedFrames_ % LIVE_TRACK_KEYFRAME != 0)
+            found = Track();
+        if (!found)
+        {
+            // a lost track falls back to the cheaper detection
+            if (mode == LIVE_MODE_TRACK)
+                lastMode_ = LIVE_MODE_PYRAMID;
+            found = PassQualityGate(gray_) && Detect(lastMode_ == LIVE_MODE_PYRAMID);
+        }
+        cv::swap(gray_, prevGray_);
+        if (!found)
+        {
+            hasPose_ = false;
+            return false;
+        }
+
+        double rms = -1.0;
+        {
+            PROFILE_STAGE("solvePnP");
+            const PoseSolverSettings& poseSettings = GetPoseSolverSettings();
+            if (poseSettings.solver == POSE_SOLVER_PLANAR)
+                rms = planar_.Estimate(objPoint_, corners_, cam->camIntrinsic, cam->camDistort, cam->projector, rvec_, tvec_,
+                    hasPose_, poseSettings.lmIterations);
+            else if (hasPose_)
+                rms = engine_->Pose(cam->camIntrinsic, cam->camDistort, rvec_, tvec_, true);
+            else
+                cv::solvePnPRansac(objPoint_, corners_, cam->camIntrinsic, cam->camDistort, rvec_, tvec_);
+        }
+        hasPose_ = true;
+        cam->projector.Project(axis_, rvec_, tvec_, projected_);
+
+        // reprojection RMS of the board : grows when the intrinsics no longer fit the camera
+        lastRms_ = rms >= 0.0 ? rms : cam->projector.ReprojectionRms(objPoint_, rvec_, tvec_, corners_);
+        return true;
+    }
+
+    // Mode that actually ran on the last frame
+    int LastMode() const { return lastMode_; }
+
+    // Reprojection RMS of the last found board(px)
+    double LastRms() const { return lastRms_; }
+
+    // Replace the intrinsics, safe to call from any thread while Process runs
+    void SetIntrinsics(const cv::Mat& camIntrinsic, const cv::Mat& camDistort)
+    {
+        // the projection kernel is picked here, once per intrinsics, not per frame
+        std::shared_ptr<LiveIntrinsics> snapshot = std::make_shared<LiveIntrinsics>();
+        snapshot->camIntrinsic = camIntrinsic.clone();
+        snapshot->camDistort = camDistort.clone();
+        snapshot->projector = PointProjector(camIntrinsic, camDistort);
+        std::shared_ptr<const LiveIntrinsics> current = std::atomic_load(&intrinsics_);
+        snapshot->version = current ? current->version + 1 : 1;
+        std::atomic_store(&intrinsics_, std::shared_ptr<const LiveIntrinsics>(snapshot));
+    }
+
+    std::shared_ptr<const LiveIntrinsics> Intrinsics() const { return std::atomic_load(&intrinsics_); }
+
+    // Draw the X, Y, Z axis of the first corner (0, 0, 0)
+    void DrawAxis(cv::Mat& image) const
+    {
+        cv::line(image, corners_[0], projected_[0], cv::Scalar(0, 0, 255), 5);
+        cv::line(image, corners_[0], projected_[1], cv::Scalar(255, 0, 0), 5);
+        cv::line(image, corners_[0], projected_[2], cv::Scalar(0, 255, 0), 5);
+    }
+
+    // Remember where the buffers live after the warm-up frames
+    void MarkWarm()
+    {
+        warmGray_[0] = gray_.data;
+        warmGray_[1] = prevGray_.data;
+        warmCorners_ = corners_.data();
+        warmProjected_ = projected_.data();
+    }
+
+    // True when no buffer moved since MarkWarm(no reallocation in our own code)
+    bool BuffersStable() const
+    {
+        // gray and prevGray swap every frame
+        bool grayStable = (gray_.data == warmGray_[0] && prevGray_.data == warmGray_[1])
+            || (gray_.data == warmGray_[1] && prevGray_.data == warmGray_[0]);
+        return grayStable && corners_.data() == warmCorners_ && projected_.data() == warmProjected_
+            && rvec_.total() == 3 && tvec_.total() == 3;
+    }
+
+    const std::vector<cv::Point2f>& Corners() const { return corners_; }
+    const std::vector<cv::Point2f>& Projected() const { return projected_; }
+    const cv::Mat& Rvec() const { return rvec_; }
+    const cv::Mat& Tvec() const { return tvec_; }
+
+private:
+    bool Detect(bool pyramid)
+    {
+        if (!pyramid)
+        {
+            if (!engine_->Detect(gray_))
+                return false;
+            engine_->GetCorners(corners_);
+            return true;
+        }
+        cv::pyrDown(gray_, small_);
+        if (!FindChessboard(small_, patternSize_, corners_))
+            return false;
+        PROFILE_STAGE("cornerSubPix");
+        for (cv::Point2f& p : corners_)
+            p *= 2.0f;
+        cv::cornerSubPix(gray_, corners_, cv::Size(3, 3), cv::Size(-1, -1),
+            cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 10, 0.01));
+        return engine_->SetCorners(corners_);
+    }
+
+    // Follow the corners of the previous frame, every corner has to be tracked
+    bool Track()
+    {
+        PROFILE_STAGE("optical flow");
+        cv::calcOpticalFlowPyrLK(prevGray_, gray_, corners_, tracked_, status_, trackErr_, cv::Size(21, 21), 3);
+        for (uchar ok : status_)
+        {
+            if (!ok)
+                return false;
+        }
+        std::copy(tracked_.begin(), tracked_.end(), corners_.begin());
+        // a folded or stretched track goes back to detection
+        return engine_->SetCorners(corners_);
+    }
+
+    cv::Size patternSize_;
+    std::vector<cv::Point3f> objPoint_;
+    cv::Ptr<BoardPoseEngine> engine_;
+    std::shared_ptr<const LiveIntrinsics> intrinsics_;
+    cv::Mat gray_, prevGray_, small_;
+    std::vector<cv::Point2f> corners_, tracked_;
+    std::vector<uchar> status_;
+    std::vector<float> trackErr_;
+    std::vector<cv::Point2f> projected_;
+    std::vector<cv::Point3f> axis_;
+    cv::Mat rvec_, tvec_;
+    PlanarPoseEstimator planar_;
+    bool hasPose_ = false;
+    int lastMode_ = LIVE_MODE_FULL;
+    double lastRms_ = 0.0;
+    int trackedFrames_ = 0;
+    const void* warmGray_[2] = { nullptr, nullptr };
+    const void* warmCorners_ = nullptr;
+    const void* warmProjected_ = nullptr;
+};
+
+// Picks the live mode of the next frame from the processing time against the frame budget.
+// A mode over budget steps down(full -> pyramid -> track), a cheaper mode steps back up once the richer one fits again.
+class LiveScheduler
+{
+public:
+    explicit LiveScheduler(double targetFps = 30.0, int minHold = 15)
+        : budgetMs_(1000.0 / targetFps), minHold_(minHold) {}
+
+    int Mode() const { return mode_; }
+
+    // Time of the frame just processed(ms) and the mode that actually ran on it
+    void Update(double ms, int ranMode)
+    {
+        double& ema = emaMs_[ranMode];
+        ema = (ema == 0.0) ? ms : ema * 0.8 + ms * 0.2;
+        frames_++;
+        modeFrames_[ranMode]++;
+        late_ += (ms > budgetMs_);
+        if (++held_ < minHold_)
+            return;
+
+        if (emaMs_[mode_] > budgetMs_ && mode_ < LIVE_MODE_TRACK)
+            Switch(mode_ + 1);
+        else if (mode_ > LIVE_MODE_FULL)
+        {
+            // the richer mode fits again, or a long stay with lots of headroom is worth a probe
+            double richer = emaMs_[mode_ - 1];
+            if ((richer > 0.0 && richer < budgetMs_ * 0.8) || (held_ >= minHold_ * 4 && emaMs_[mode_] < budgetMs_ * 0.5))
+                Switch(mode_ - 1);
+        }
+    }
+
+    void PrintStats(double elapsedSec) const
+    {
+        if (frames_ == 0)
+            return;
+        const char* names[3] = { "full", "pyramid", "track" };
+        std::cout << "===== Live Scheduler =====" << std::endl;
+        std::cout << "Frames : " << frames_ << ", " << frames_ / elapsedSec << " fps (target " << 1000.0 / budgetMs_
+            << "), late : " << late_ << ", mode switches : " << switches_ << std::endl;
+        for (int m = 0; m < 3; m++)
+            std::cout << names[m] << " : " << modeFrames_[m] << " frames, " << emaMs_[m] << " ms" << std::endl;
+    }
+
+private:
+    void Switch(int mode)
+    {
+        // the last time of the new mode may be stale, start its average again
+        emaMs_[mode] = (mode < mode_) ? 0.0 : emaMs_[mode];
+        mode_ = mode;
+        held_ = 0;
+        switches_++;
+    }
+
+    double budgetMs_;
+    int minHold_;
+    int mode_ = LIVE_MODE_FULL;
+    int held_ = 0;
+    int frames_ = 0;
+    int late_ = 0;
+    int switches_ = 0;
+    int modeFrames_[3] = { 0, 0, 0 };
+    double emaMs_[3] = { 0.0, 0.0, 0.0 };
+};
+
+// Health of the intrinsics in the live loop.
+// The rolling median of the per-frame reprojection RMS is compared with the baseline measured after the last swap;
+// when it degrades, a warm-started recalibration runs on recent views in the background. The result is swapped in only
+// when it meets the quality target and fits the views held out of the solve better than the intrinsics in use.
+class DriftMonitor
+{
+public:
+    DriftMonitor(cv::Size imageSize, const std::vector<cv::Point3f>& objPoint, int window = 60, double degradeRatio = 2.0)
+        : imageSize_(imageSize), objPoint_(objPoint), window_(window), degradeRatio_(degradeRatio) {}
+
+    // Per-frame update after the tracker found the board
+    void Update(LivePoseTracker& tracker)
+    {
+        rms_.push_back(tracker.LastRms());
+        if ((int)rms_.size() > window_)
+            rms_.pop_front();
+        KeepView(tracker.Corners());
+
+        if ((int)rms_.size() == window_)
+        {
+            health_ = RollingMedian();
+            if (baseline_ == 0.0)
+                baseline_ = health_;
+            bool degraded = health_ > std::max(baseline_ * degradeRatio_, baseline_ + 0.3);
+            if (degraded && (int)views_.size() >= DRIFT_MIN_VIEWS && !calibrator_.Busy())
+            {
+                std::shared_ptr<const LiveIntrinsics> cam = tracker.Intrinsics();
+                std::vector<std::vector<cv::Point2f>> imgPoints;
+                std::vector<std::vector<cv::Point2f>> heldOut;
+                for (size_t k = 0; k < views_.size(); k++)
+                    (k % DRIFT_HOLDOUT_EVERY == DRIFT_HOLDOUT_EVERY - 1 ? heldOut : imgPoints).push_back(views_[k]);
+                std::vector<std::vector<cv::Point3f>> objPoints(imgPoints.size(), objPoint_);
+                if (calibrator_.Start(objPoints, imgPoints, imageSize_, cam->camIntrinsic, cam->camDistort))
+                {
+                    heldOut_.swap(heldOut);
+                    recalibrations_++;
+                }
+            }
+        }
+
+        // the in-sample rms of the solve says little(more free parameters, few views), so both sets of intrinsics
+        // are scored on the held-out views; a rejected result waits for a full window before the next try
+        CalibSnapshot result;
+        if (calibrator_.Poll(result))
+        {
+            std::shared_ptr<const LiveIntrinsics> cam = tracker.Intrinsics();
+            if (MeetsQualityTarget(result.quality)
+                && HeldOutRms(result.camIntrinsic, result.camDistort) < HeldOutRms(cam->camIntrinsic, cam->camDistort))
+            {
+                tracker.SetIntrinsics(result.camIntrinsic, result.camDistort);
+                swaps_++;
+                baseline_ = 0.0;
+            }
+            rms_.clear();
+        }
+    }
+
+    double Health() const { return health_; }
+    double Baseline() const { return baseline_; }
+
+    void PrintStats() const
+    {
+        std::cout << "===== Drift Monitor =====" << std::endl;
+        std::cout << "Health(median rms) : " << health_ << " px, baseline : " << baseline_ << " px, recalibrations : "
+            << recalibrations_ << ", swaps : " << swaps_ << std::endl;
+    }
+
+private:
+    // Keep the recent views that moved enough from the last kept one
+    void KeepView(const std::vector<cv::Point2f>& corners)
+    {
+        if (!views_.empty())
+        {
+            const std::vector<cv::Point2f>& last = views_.back();
+            double move = 0.0;
+            for (size_t k = 0; k < corners.size(); k++)
+                move += cv::norm(corners[k] - last[k]);
+            if (move / corners.size() < DRIFT_VIEW_MOVE)
+                return;
+        }
+        views_.push_back(corners);
+        if ((int)views_.size() > DRIFT_MAX_VIEWS)
+            views_.pop_front();
+    }
+
+    // Reprojection RMS(px) of the held-out views, each with its own pose from these intrinsics
+    double HeldOutRms(const cv::Mat& camIntrinsic, const cv::Mat& camDistort) const
+    {
+        double err = 0.0;
+        size_t pointNum = 0;
+        std::vector<cv::Point2f> projected;
+        for (const std::vector<cv::Point2f>& view : heldOut_)
+        {
+            cv::Mat rvec, tvec;
+            if (!cv::solvePnP(objPoint_, view, camIntrinsic, camDistort, rvec, tvec))
+                return std::numeric_limits<double>::infinity();
+            cv::projectPoints(objPoint_, rvec, tvec, camIntrinsic, camDistort, projected);
+            for (size_t k = 0; k < view.size(); k++)
+            {
+                cv::Point2f d = view[k] - projected[k];
+                err += d.x * d.x + d.y * d.y;
+            }
+            pointNum += view.size();
+        }
+        return pointNum > 0 ? std::sqrt(err / pointNum) : std::numeric_limits<double>::infinity();
+    }
+
+    double RollingMedian() const
+    {
+        std::vector<double> sorted(rms_.begin(), rms_.end());
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+
+    cv::Size imageSize_;
+    std::vector<cv::Point3f> objPoint_;
+    int window_;
+    double degradeRatio_;
+    std::deque<double> rms_;
+    std::deque<std::vector<cv::Point2f>> views_;
+    std::vector<std::vector<cv::Point2f>> heldOut_;     // views left out of the running recalibration
+    double health_ = 0.0;
+    double baseline_ = 0.0;
+    int recalibrations_ = 0;
+    int swaps_ = 0;
+    BackgroundCalibrator calibrator_;
+};
+
+// Value at the fraction q of a sorted list
+inline double SortedPercentile(const std::vector<double>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0.0;
+    return sorted[(size_t)(q * (sorted.size() - 1) + 0.5)];
+}
+
+// Live mode : the live loop without a window on a recorded source(camera.xml gives the intrinsics).
+// Unpaced replay measures the throughput, paced replay at fps the latency from frame arrival to pose.
+// The two passes see the same frames, so runs on any machine are comparable. maxMB : memory for the recording.
+inline int RunLiveReplay(int boardRows, int boardCols, float boardSize, const std::string& spec, double fps,
+    double maxMB = REPLAY_MAX_MB)
+{
+    cv::Mat camIntrinsic, camDistort;
+    cv::FileStorage fs("camera.xml", cv::FileStorage::READ);
+    if (fs.isOpened())
+    {
+        fs["intrinsic"] >> camIntrinsic;
+        fs["distortion"] >> camDistort;
+    }
+    if (camIntrinsic.empty())
+    {
+        std::cout << "[Err] camera.xml has no intrinsic parameters" << std::endl;
+        return -1;
+    }
+    cv::Ptr<FrameSource> recorded = CreateFrameSource(spec);
+    if (!recorded)
+        return -1;
+
+    std::vector<cv::Point3f> objPoint = BuildObjectPoint(boardRows, boardCols, boardSize);
+    std::cout << "===== Live Replay (" << recorded->Name() << ") =====" << std::endl;
+    ReplayFrameSource source(*recorded, fps, false, 1, maxMB);
+    if (!source.IsOpened())
+    {
+        std::cout << "[Err] No frame in : " << spec << std::endl;
+        return -1;
+    }
+    if (source.Truncated())
+        std::cout << "Recording stopped at " << source.FrameCount() << " frames (" << maxMB << " MB, see --replay-mb=)" << std::endl;
+
+    // a short recording is looped to about 10 s of frames
+    int loops = std::max(1, (int)(fps * 10.0) / source.FrameCount());
+    cv::Mat frame;
+    double timestampMs;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        source.Rewind(pass == 1, loops);
+        LivePoseTracker tracker(boardRows, boardCols, boardSize, camIntrinsic, camDistort);
+        LiveScheduler scheduler(fps);
+        cv::Ptr<DriftMonitor> drift;
+        std::vector<double> processMs, latencyMs;
+        int foundNum = 0;
+        int64 start = cv::getTickCount();
+        while (source.Read(frame, timestampMs))
+        {
+            int64 tick = cv::getTickCount();
+            bool found = tracker.Process(frame, scheduler.Mode());
+            double ms = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+            if (found)
+            {
+                if (!drift)
+                    drift = cv::makePtr<DriftMonitor>(frame.size(), objPoint);
+                drift->Update(tracker);
+                foundNum++;
+            }
+            scheduler.Update(ms, tracker.LastMode());
+            processMs.push_back(ms);
+            latencyMs.push_back(source.Now() - timestampMs);
+        }
+        double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+        std::sort(processMs.begin(), processMs.end());
+        std::sort(latencyMs.begin(), latencyMs.end());
+
+        std::cout << (pass == 0 ? "[unpaced] " : "[paced] ") << processMs.size() << " frames, found : " << foundNum
+            << ", " << processMs.size() / elapsed << " fps, process p50 / p99 : " << SortedPercentile(processMs, 0.5)
+            << " / " << SortedPercentile(processMs, 0.99) << " ms";
+        if (pass == 1)
+            std::cout << ", latency p50 / p99 : " << SortedPercentile(latencyMs, 0.5) << " / "
+                << SortedPercentile(latencyMs, 0.99) << " ms, dropped : " << source.Dropped();
+        std::cout << std::endl;
+        scheduler.PrintStats(elapsed);
+        if (drift)
+            drift->PrintStats();
+    }
+    return 0;
+}
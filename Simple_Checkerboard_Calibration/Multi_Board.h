@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Calib_Common.h"
+
+#define MULTI_BOARD_MAX      (8)    // # Maximum boards searched in one image
+
+// Cover a found board(and its outer squares) with flat gray, so the next search finds another instance
+inline void MaskBoard(cv::Mat& gray, const std::vector<cv::Point2f>& corners, cv::Size patternSize)
+{
+    std::vector<cv::Point2f> hull;
+    cv::convexHull(corners, hull);
+    cv::Point2f center(0.0f, 0.0f);
+    for (const cv::Point2f& p : corners)
+        center += p;
+    center *= 1.0f / corners.size();
+
+    // the inner corners span (N - 1) squares, the printed board N + 1 : grow the hull by the outer ring
+    int n = std::max(2, std::min(patternSize.width, patternSize.height));
+    float scale = (float)(n + 1) / (n - 1);
+    std::vector<cv::Point> polygon;
+    for (const cv::Point2f& p : hull)
+        polygon.push_back(center + (p - center) * scale);
+    cv::fillConvexPoly(gray, polygon, cv::Scalar(128));
+}
+
+// Find every instance of the board in one image.
+// Each found board is masked out before the next search, so one decode gives several views.
+inline int DetectAllChessboards(const cv::Mat& src, cv::Size patternSize, std::vector<std::vector<cv::Point2f>>& boards,
+    int maxBoards = MULTI_BOARD_MAX)
+{
+    cv::Mat gray;
+    if (src.channels() == 1)
+        gray = src.clone();
+    else
+        cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+    // keep the original pixels for the subpixel refinement
+    cv::Mat original = gray.clone();
+
+    boards.clear();
+    std::vector<cv::Point2f> corners;
+    while ((int)boards.size() < maxBoards && FindChessboard(gray, patternSize, corners))
+    {
+        MaskBoard(gray, corners, patternSize);
+        RefineCorners(original, corners, patternSize);
+        boards.push_back(corners);
+    }
+    return (int)boards.size();
+}
+
+// Multi mode : every board instance of temp\N.jpg becomes its own view
+inline int RunMultiBoardCalibration(int boardRows, int boardCols, float boardSize)
+{
+    std::vector<cv::Mat> srcImg = LoadPatternImages("temp\\");
+    if (srcImg.empty())
+        return -1;
+
+    cv::Size patternSize(boardCols, boardRows);
+    int imageNum = (int)srcImg.size();
+    std::vector<std::vector<std::vector<cv::Point2f>>> found(imageNum);
+    int64 tick = cv::getTickCount();
+    cv::parallel_for_(cv::Range(0, imageNum), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; i++)
+            DetectAllChessboards(srcImg[i], patternSize, found[i]);
+    });
+    double detectMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    for (int i = 0; i < imageNum; i++)
+    {
+        std::cout << (found[i].empty() ? "[FAIL] : " : "[PASS] : ") << i << ".jpg (" << found[i].size() << " boards)" << std::endl;
+        imgPoints.insert(imgPoints.end(), found[i].begin(), found[i].end());
+    }
+    std::cout << "Views : " << imgPoints.size() << " from " << imageNum << " images (" << detectMs << " ms)" << std::endl;
+    if (imgPoints.size() < 3)
+    {
+        std::cout << "[Err] Not enough views to calibrate" << std::endl;
+        return -1;
+    }
+
+    std::vector<std::vector<cv::Point3f>> objPoints(imgPoints.size(), BuildObjectPoint(boardRows, boardCols, boardSize));
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    double rms;
+    {
+        PROFILE_STAGE("calibrateCamera");
+        rms = cv::calibrateCamera(objPoints, imgPoints, srcImg[0].size(), camIntrinsic, camDistort, camRotVec, camTransVec);
+    }
+    std::cout << "===== Multi-board Calibration Result =====" << std::endl;
+    std::cout << "RMS : " << rms << " px" << std::endl;
+    std::cout << "Camera intrinsic parameters :" << std::endl << camIntrinsic << std::endl;
+    std::cout << "Lens distortion coefficients :" << std::endl << camDistort << std::endl;
+
+    cv::FileStorage fs("camera.xml", cv::FileStorage::WRITE);
+    fs << "intrinsic" << camIntrinsic;
+    fs << "distortion" << camDistort;
+    return 0;
+}
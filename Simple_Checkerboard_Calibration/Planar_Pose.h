@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include <opencv2/calib3d.hpp>
+
+#include "Projection_Kernels.h"
+
+#define PLANAR_LM_ITERATIONS  (3)    // # LM steps after the closed-form pose
+#define PLANAR_AMBIGUITY      (2.0)  // # Error ratio below which the two IPPE solutions are both plausible
+
+enum PoseSolver
+{
+    POSE_SOLVER_RANSAC = 0,                 // solvePnPRansac, then solvePnP from the last pose
+    POSE_SOLVER_PLANAR = 1                  // IPPE closed form, previous frame disambiguation, LM refinement
+};
+
+struct PoseSolverSettings
+{
+    int solver = POSE_SOLVER_RANSAC;
+    int lmIterations = PLANAR_LM_ITERATIONS;
+};
+
+inline PoseSolverSettings& GetPoseSolverSettings()
+{
+    static PoseSolverSettings settings;
+    return settings;
+}
+
+// Angle between two rotations(rad)
+inline double RotationDistance(const cv::Matx33d& Ra, const cv::Matx33d& Rb)
+{
+    cv::Matx33d Rd = Ra.t() * Rb;
+    double c = (Rd(0, 0) + Rd(1, 1) + Rd(2, 2) - 1.0) * 0.5;
+    return std::acos(std::max(-1.0, std::min(1.0, c)));
+}
+
+// Pose of a planar board(Z = 0 object points, no outliers). IPPE gives the two poses that explain the homography,
+// the one closest to the previous frame is kept when their errors are alike(a board seen almost front on flips
+// between them otherwise), and a few LM steps on the projection kernel refine it.
+class PlanarPoseEstimator
+{
+public:
+    // rvec, tvec : 3x1 CV_64F, the previous pose on input when hasPrevious. Returns the reprojection RMS(px).
+    double Estimate(const std::vector<cv::Point3f>& objPoint, const std::vector<cv::Point2f>& corners,
+        const cv::Mat& camIntrinsic, const cv::Mat& camDistort, const PointProjector& projector,
+        cv::Mat& rvec, cv::Mat& tvec, bool hasPrevious, int lmIterations = PLANAR_LM_ITERATIONS)
+    {
+        int solutionNum = cv::solvePnPGeneric(objPoint, corners, camIntrinsic, camDistort, rvecs_, tvecs_, false,
+            cv::SOLVEPNP_IPPE, cv::noArray(), cv::noArray(), reprojError_);
+        if (solutionNum == 0)
+            return -1.0;
+
+        // the solutions come sorted by reprojection error
+        int best = 0;
+        if (solutionNum > 1 && hasPrevious && reprojError_(1) < reprojError_(0) * PLANAR_AMBIGUITY)
+        {
+            cv::Matx33d Rprev = RodriguesToMatrix(cv::Vec3d(rvec));
+            double d0 = RotationDistance(Rprev, RodriguesToMatrix(cv::Vec3d(rvecs_[0])));
+            double d1 = RotationDistance(Rprev, RodriguesToMatrix(cv::Vec3d(rvecs_[1])));
+            best = d1 < d0 ? 1 : 0;
+        }
+        if (best == 1)
+            overrideNum_++;
+        rvecs_[best].convertTo(rvec, CV_64F);
+        tvecs_[best].convertTo(tvec, CV_64F);
+
+        // the generic distortion model has no jacobian kernel
+        if (!projector.HasKernel())
+        {
+            cv::solvePnPRefineLM(objPoint, corners, camIntrinsic, camDistort, rvec, tvec,
+                cv::TermCriteria(cv::TermCriteria::COUNT, lmIterations, 0.0));
+            return projector.ReprojectionRms(objPoint, rvec, tvec, corners);
+        }
+        return RefineLM(objPoint, corners, projector, rvec, tvec, lmIterations);
+    }
+
+    // Frames where the previous pose kept the second solution over the lowest error one
+    int OverrideCount() const { return overrideNum_; }
+
+private:
+    // Levenberg-Marquardt on the 6 pose parameters, R <- exp([w]) R, t <- t + dt like the kernel jacobian
+    double RefineLM(const std::vector<cv::Point3f>& objPoint, const std::vector<cv::Point2f>& corners,
+        const PointProjector& projector, cv::Mat& rvec, cv::Mat& tvec, int iterations)
+    {
+        int n = (int)objPoint.size();
+        projected_.resize(n);
+        jacobian_.resize(n * 12);
+        cv::Matx33d R = RodriguesToMatrix(cv::Vec3d(rvec));
+        cv::Vec3d t(tvec);
+        double err = SquaredError(objPoint, corners, projector, R, t, jacobian_.data());
+        double lambda = 1e-3;
+        for (int it = 0; it < iterations; it++)
+        {
+            cv::Matx66d A;
+            cv::Vec6d b;
+            for (int k = 0; k < n * 2; k++)
+            {
+                const double* J = &jacobian_[k * 6];
+                double r = (k % 2 == 0) ? corners[k / 2].x - projected_[k / 2].x : corners[k / 2].y - projected_[k / 2].y;
+                for (int i = 0; i < 6; i++)
+                {
+                    b[i] += J[i] * r;
+                    for (int j = i; j < 6; j++)
+                        A(i, j) += J[i] * J[j];
+                }
+            }
+            for (int i = 0; i < 6; i++)
+            {
+                for (int j = 0; j < i; j++)
+                    A(i, j) = A(j, i);
+            }
+
+            // a rejected step raises lambda and tries again from the same pose
+            while (lambda < 1e6)
+            {
+                cv::Matx66d D = A;
+                for (int i = 0; i < 6; i++)
+                    D(i, i) *= 1.0 + lambda;
+                cv::Vec6d delta;
+                if (!cv::solve(D, b, delta, cv::DECOMP_CHOLESKY))
+                    break;
+                cv::Matx33d Rn = RodriguesToMatrix(cv::Vec3d(delta[0], delta[1], delta[2])) * R;
+                cv::Vec3d tn = t + cv::Vec3d(delta[3], delta[4], delta[5]);
+                double errNew = SquaredError(objPoint, corners, projector, Rn, tn, nullptr);
+                if (errNew < err)
+                {
+                    R = Rn;
+                    t = tn;
+                    lambda *= 0.1;
+                    break;
+                }
+                lambda *= 10.0;
+            }
+            if (lambda >= 1e6)
+                break;
+            err = SquaredError(objPoint, corners, projector, R, t, jacobian_.data());
+        }
+
+        cv::Vec3d r;
+        cv::Rodrigues(R, r);
+        for (int i = 0; i < 3; i++)
+        {
+            rvec.at<double>(i) = r[i];
+            tvec.at<double>(i) = t[i];
+        }
+        return std::sqrt(err / n);
+    }
+
+    double SquaredError(const std::vector<cv::Point3f>& objPoint, const std::vector<cv::Point2f>& corners,
+        const PointProjector& projector, const cv::Matx33d& R, const cv::Vec3d& t, double* jacobian)
+    {
+        projector.Project(objPoint.data(), (int)objPoint.size(), R, t, projected_.data(), jacobian);
+        double err = 0.0;
+        for (size_t k = 0; k < objPoint.size(); k++)
+        {
+            cv::Point2f d = corners[k] - projected_[k];
+            err += d.x * d.x + d.y * d.y;
+        }
+        return err;
+    }
+
+    std::vector<cv::Mat> rvecs_, tvecs_;
+    cv::Mat_<double> reprojError_;              // fixed type : CV_32F otherwise for float points
+    std::vector<cv::Point2f> projected_;
+    std::vector<double> jacobian_;
+    int overrideNum_ = 0;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+
+// Distortion models with their own projection kernel(coefficients in the order of OpenCV)
+enum DistortionModel
+{
+    DISTORTION_NONE = 0,                    // pinhole
+    DISTORTION_RADIAL = 1,                  // k1, k2, k3
+    DISTORTION_RADTAN = 2,                  // k1, k2, p1, p2, k3(the default of calibrateCamera)
+    DISTORTION_RATIONAL = 3,                // + k4, k5, k6(CALIB_RATIONAL_MODEL)
+    DISTORTION_GENERIC = 4                  // thin prism or tilt : cv::projectPoints
+};
+
+struct ProjectionParams
+{
+    double fx, fy, cx, cy;
+    double k1, k2, p1, p2, k3, k4, k5, k6;
+};
+
+// Rotation matrix of a rotation vector
+inline cv::Matx33d RodriguesToMatrix(const cv::Vec3d& r)
+{
+    double theta = std::sqrt(r.dot(r));
+    cv::Matx33d K(0, -r[2], r[1], r[2], 0, -r[0], -r[1], r[0], 0);
+    if (theta < 1e-12)
+        return cv::Matx33d::eye() + K;
+    K *= 1.0 / theta;
+    return cv::Matx33d::eye() + K * std::sin(theta) + K * K * (1.0 - std::cos(theta));
+}
+
+// Project n points with the pose R, t. The model flags are template arguments, so the terms of the
+// zero coefficients are compiled out instead of evaluated.
+// jacobian(optional) : 2n x 6 row-major, d(u, v) / d(w, t) for the update R <- exp([w]) R, t <- t + dt.
+template<bool Radial, bool Tangential, bool Rational>
+void ProjectKernel(const cv::Point3f* objPoint, int n, const cv::Matx33d& R, const cv::Vec3d& t, const ProjectionParams& p,
+    cv::Point2f* imgPoint, double* jacobian)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const cv::Point3f& o = objPoint[i];
+        double px = R(0, 0) * o.x + R(0, 1) * o.y + R(0, 2) * o.z;
+        double py = R(1, 0) * o.x + R(1, 1) * o.y + R(1, 2) * o.z;
+        double pz = R(2, 0) * o.x + R(2, 1) * o.y + R(2, 2) * o.z;
+        double iz = 1.0 / (pz + t[2]);
+        double x = (px + t[0]) * iz, y = (py + t[1]) * iz;
+        double r2 = x * x + y * y;
+
+        double radial = 1.0, dRadial = 0.0;     // dRadial : d radial / d r2
+        if (Radial)
+        {
+            double a = 1.0 + r2 * (p.k1 + r2 * (p.k2 + r2 * p.k3));
+            double da = p.k1 + r2 * (2.0 * p.k2 + 3.0 * r2 * p.k3);
+            if (Rational)
+            {
+                double b = 1.0 + r2 * (p.k4 + r2 * (p.k5 + r2 * p.k6));
+                double db = p.k4 + r2 * (2.0 * p.k5 + 3.0 * r2 * p.k6);
+                radial = a / b;
+                dRadial = (da * b - a * db) / (b * b);
+            }
+            else
+            {
+                radial = a;
+                dRadial = da;
+            }
+        }
+        double xd = x * radial, yd = y * radial;
+        if (Tangential)
+        {
+            xd += 2.0 * p.p1 * x * y + p.p2 * (r2 + 2.0 * x * x);
+            yd += p.p1 * (r2 + 2.0 * y * y) + 2.0 * p.p2 * x * y;
+        }
+        imgPoint[i] = cv::Point2f((float)(p.fx * xd + p.cx), (float)(p.fy * yd + p.cy));
+
+        if (!jacobian)
+            continue;
+        // d(xd, yd) / d(x, y)
+        double a11 = radial + 2.0 * x * x * dRadial, a12 = 2.0 * x * y * dRadial;
+        double a21 = a12, a22 = radial + 2.0 * y * y * dRadial;
+        if (Tangential)
+        {
+            a11 += 2.0 * p.p1 * y + 6.0 * p.p2 * x;
+            a12 += 2.0 * p.p1 * x + 2.0 * p.p2 * y;
+            a21 += 2.0 * p.p1 * x + 2.0 * p.p2 * y;
+            a22 += 6.0 * p.p1 * y + 2.0 * p.p2 * x;
+        }
+        // d(u, v) / d(camera point), then the rotation part is -[R X]x
+        double g[2][3] = {
+            { p.fx * a11 * iz, p.fx * a12 * iz, -p.fx * (a11 * x + a12 * y) * iz },
+            { p.fy * a21 * iz, p.fy * a22 * iz, -p.fy * (a21 * x + a22 * y) * iz } };
+        for (int r = 0; r < 2; r++)
+        {
+            double* J = jacobian + (2 * i + r) * 6;
+            J[0] = g[r][2] * py - g[r][1] * pz;
+            J[1] = g[r][0] * pz - g[r][2] * px;
+            J[2] = g[r][1] * px - g[r][0] * py;
+            J[3] = g[r][0];
+            J[4] = g[r][1];
+            J[5] = g[r][2];
+        }
+    }
+}
+
+typedef void (*ProjectFn)(const cv::Point3f*, int, const cv::Matx33d&, const cv::Vec3d&, const ProjectionParams&,
+    cv::Point2f*, double*);
+
+// Smallest model that reproduces the coefficients(zero coefficients are dropped)
+inline int DetectDistortionModel(const cv::Mat& camDistort)
+{
+    double d[14] = { 0 };
+    int n = camDistort.empty() ? 0 : std::min(14, (int)camDistort.total());
+    for (int k = 0; k < n; k++)
+        d[k] = camDistort.at<double>(k);
+    for (int k = 8; k < 14; k++)
+    {
+        if (d[k] != 0.0)
+            return DISTORTION_GENERIC;
+    }
+    if (d[5] != 0.0 || d[6] != 0.0 || d[7] != 0.0)
+        return DISTORTION_RATIONAL;
+    if (d[2] != 0.0 || d[3] != 0.0)
+        return DISTORTION_RADTAN;
+    if (d[0] != 0.0 || d[1] != 0.0 || d[4] != 0.0)
+        return DISTORTION_RADIAL;
+    return DISTORTION_NONE;
+}
+
+// Projection with the kernel of the distortion model, chosen once for the intrinsics
+class PointProjector
+{
+public:
+    PointProjector() {}
+
+    PointProjector(const cv::Mat& camIntrinsic, const cv::Mat& camDistort)
+        : camIntrinsic_(camIntrinsic.clone()), camDistort_(camDistort.clone())
+    {
+        double d[8] = { 0 };
+        int n = camDistort.empty() ? 0 : std::min(8, (int)camDistort.total());
+        for (int k = 0; k < n; k++)
+            d[k] = camDistort.at<double>(k);
+        params_ = { camIntrinsic.at<double>(0, 0), camIntrinsic.at<double>(1, 1), camIntrinsic.at<double>(0, 2),
+            camIntrinsic.at<double>(1, 2), d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7] };
+        model_ = DetectDistortionModel(camDistort);
+        switch (model_)
+        {
+        case DISTORTION_NONE: kernel_ = ProjectKernel<false, false, false>; break;
+        case DISTORTION_RADIAL: kernel_ = ProjectKernel<true, false, false>; break;
+        case DISTORTION_RADTAN: kernel_ = ProjectKernel<true, true, false>; break;
+        case DISTORTION_RATIONAL: kernel_ = ProjectKernel<true, true, true>; break;
+        default: kernel_ = nullptr; break;
+        }
+    }
+
+    int Model() const { return model_; }
+
+    const char* ModelName() const
+    {
+        const char* names[5] = { "none", "radial", "radtan", "rational", "generic" };
+        return names[model_];
+    }
+
+    // The generic model has no kernel(and no jacobian), it goes through cv::projectPoints
+    bool HasKernel() const { return kernel_ != nullptr; }
+
+    void Project(const cv::Point3f* objPoint, int n, const cv::Matx33d& R, const cv::Vec3d& t, cv::Point2f* imgPoint,
+        double* jacobian = nullptr) const
+    {
+        if (kernel_)
+        {
+            kernel_(objPoint, n, R, t, params_, imgPoint, jacobian);
+            return;
+        }
+        CV_Assert(jacobian == nullptr);
+        cv::Vec3d rvec;
+        cv::Rodrigues(R, rvec);
+        std::vector<cv::Point2f> projected;
+        cv::projectPoints(std::vector<cv::Point3f>(objPoint, objPoint + n), rvec, t, camIntrinsic_, camDistort_, projected);
+        std::copy(projected.begin(), projected.end(), imgPoint);
+    }
+
+    // Same arguments as cv::projectPoints(imgPoint keeps its storage when the size does not change)
+    void Project(const std::vector<cv::Point3f>& objPoint, const cv::Mat& rvec, const cv::Mat& tvec,
+        std::vector<cv::Point2f>& imgPoint) const
+    {
+        imgPoint.resize(objPoint.size());
+        Project(objPoint.data(), (int)objPoint.size(), RodriguesToMatrix(cv::Vec3d(rvec)), cv::Vec3d(tvec), imgPoint.data());
+    }
+
+    // RMS distance between the corners and the projected board, without a buffer
+    double ReprojectionRms(const std::vector<cv::Point3f>& objPoint, const cv::Mat& rvec, const cv::Mat& tvec,
+        const std::vector<cv::Point2f>& corners) const
+    {
+        cv::Matx33d R = RodriguesToMatrix(cv::Vec3d(rvec));
+        cv::Vec3d t(tvec);
+        double err = 0.0;
+        for (size_t k = 0; k < objPoint.size(); k++)
+        {
+            cv::Point2f p;
+            Project(&objPoint[k], 1, R, t, &p);
+            cv::Point2f d = corners[k] - p;
+            err += d.x * d.x + d.y * d.y;
+        }
+        return objPoint.empty() ? 0.0 : std::sqrt(err / objPoint.size());
+    }
+
+private:
+    cv::Mat camIntrinsic_, camDistort_;
+    ProjectionParams params_ = {};
+    ProjectFn kernel_ = nullptr;
+    int model_ = DISTORTION_NONE;
+};
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Stage_Profiler.h"
+
+// Parameters of the saddle-point chessboard detector
+struct SaddleDetectorParams
+{
+    double sigma = 1.5;                     // gaussian scale of the response(px of the working image)
+    double thresholdRatio = 0.05;           // keep responses above ratio * max response
+    int nmsRadius = 4;                      // non-maximum suppression radius(px of the working image)
+    int maxCandidates = 2000;
+    int pyramidLevels = 0;                  // compute the response on a pyrDown image(0 : full resolution)
+    int maxSeeds = 10;                      // strongest candidates tried as the grid origin
+    double ringRadius = 3.0;                // X-junction ring radius(x sigma, at least 3 px)
+};
+
+// Saddle response(Ixy^2 - Ixx * Iyy) : positive where the intensity curves up in one direction and down in the other.
+// The second derivatives come from separable kernels, so each pass is a row + column filter.
+inline void SaddleResponse(const cv::Mat& gray, double sigma, cv::Mat& response, cv::Mat& smooth)
+{
+    cv::GaussianBlur(gray, smooth, cv::Size(), sigma, sigma, cv::BORDER_REPLICATE);
+
+    cv::Mat d0, d1, d2;
+    cv::getDerivKernels(d2, d0, 2, 0, 3, false, CV_32F);    // d2 : 2nd derivative, d0 : smoothing
+    cv::getDerivKernels(d1, d0, 1, 0, 3, false, CV_32F);    // d1 : 1st derivative
+    cv::Mat ixx, iyy, ixy;
+    cv::sepFilter2D(smooth, ixx, CV_32F, d2, d0);
+    cv::sepFilter2D(smooth, iyy, CV_32F, d0, d2);
+    cv::sepFilter2D(smooth, ixy, CV_32F, d1, d1);
+
+    // written as an expression so OpenCV evaluates it with its vectorized arithmetic
+    response = ixy.mul(ixy) - ixx.mul(iyy);
+}
+
+// True when a ring around p crosses dark and light exactly 4 times : an X-junction between 4 squares.
+// The L-corners where the outer squares meet the white margin also respond(about 1/4 of an X-junction),
+// but their ring has a single dark sector.
+inline bool IsXJunction(const cv::Mat& smooth, cv::Point p, double radius)
+{
+    const int samples = 16;
+    uchar ring[samples];
+    uchar lo = 255, hi = 0;
+    for (int k = 0; k < samples; k++)
+    {
+        double a = 2.0 * CV_PI * k / samples;
+        int x = cvRound(p.x + radius * std::cos(a)), y = cvRound(p.y + radius * std::sin(a));
+        if (x < 0 || y < 0 || x >= smooth.cols || y >= smooth.rows)
+            return false;
+        ring[k] = smooth.at<uchar>(y, x);
+        lo = std::min(lo, ring[k]);
+        hi = std::max(hi, ring[k]);
+    }
+    int mid = (lo + hi) / 2, changes = 0;
+    for (int k = 0; k < samples; k++)
+        changes += ((ring[k] > mid) != (ring[(k + 1) % samples] > mid)) ? 1 : 0;
+    return changes == 4;
+}
+
+// Local maxima of the response above the threshold that are X-junctions, strongest first
+inline void SaddleCandidates(const cv::Mat& response, const cv::Mat& smooth, const SaddleDetectorParams& params,
+    std::vector<cv::Point2f>& candidates, std::vector<float>& strength)
+{
+    double maxVal = 0.0;
+    cv::minMaxLoc(response, nullptr, &maxVal);
+    cv::Mat dilated;
+    cv::dilate(response, dilated, cv::getStructuringElement(cv::MORPH_RECT,
+        cv::Size(params.nmsRadius * 2 + 1, params.nmsRadius * 2 + 1)));
+    float threshold = (float)(maxVal * params.thresholdRatio);
+
+    std::vector<std::pair<float, cv::Point>> peaks;
+    for (int y = params.nmsRadius; y < response.rows - params.nmsRadius; y++)
+    {
+        const float* r = response.ptr<float>(y);
+        const float* d = dilated.ptr<float>(y);
+        for (int x = params.nmsRadius; x < response.cols - params.nmsRadius; x++)
+        {
+            if (r[x] > threshold && r[x] >= d[x])
+                peaks.push_back(std::make_pair(r[x], cv::Point(x, y)));
+        }
+    }
+    std::sort(peaks.begin(), peaks.end(), [](const std::pair<float, cv::Point>& a, const std::pair<float, cv::Point>& b)
+    {
+        return a.first > b.first;
+    });
+
+    candidates.clear();
+    strength.clear();
+    double radius = std::max(3.0, params.ringRadius * params.sigma);
+    for (const auto& p : peaks)
+    {
+        if ((int)candidates.size() >= params.maxCandidates)
+            break;
+        if (!IsXJunction(smooth, p.second, radius))
+            continue;
+        candidates.push_back(cv::Point2f((float)p.second.x, (float)p.second.y));
+        strength.push_back(p.first);
+    }
+}
+
+// Index of the candidate nearest to p within radius(-1 when none)
+inline int NearestCandidate(const std::vector<cv::Point2f>& candidates, cv::Point2f p, float radius)
+{
+    int best = -1;
+    float bestDist = radius * radius;
+    for (size_t k = 0; k < candidates.size(); k++)
+    {
+        cv::Point2f d = candidates[k] - p;
+        float dist = d.x * d.x + d.y * d.y;
+        if (dist < bestDist)
+        {
+            bestDist = dist;
+            best = (int)k;
+        }
+    }
+    return best;
+}
+
+// Grow a grid from the seed candidate : each node predicts its 4 neighbors from the local steps
+inline bool AssembleGrid(const std::vector<cv::Point2f>& candidates, int seed, cv::Size patternSize, std::vector<cv::Point2f>& corners)
+{
+    // the two nearest non-collinear neighbors give the grid axes
+    cv::Point2f origin = candidates[seed];
+    std::vector<std::pair<float, int>> near;
+    for (size_t k = 0; k < candidates.size(); k++)
+    {
+        if ((int)k != seed)
+            near.push_back(std::make_pair((float)cv::norm(candidates[k] - origin), (int)k));
+    }
+    if (near.size() < 4)
+        return false;
+    std::partial_sort(near.begin(), near.begin() + std::min<size_t>(8, near.size()), near.end());
+    cv::Point2f u = candidates[near[0].second] - origin, v;
+    bool foundV = false;
+    for (size_t k = 1; k < std::min<size_t>(8, near.size()); k++)
+    {
+        cv::Point2f d = candidates[near[k].second] - origin;
+        double cosAngle = std::abs(u.dot(d)) / (cv::norm(u) * cv::norm(d));
+        if (cosAngle < 0.5)
+        {
+            v = d;
+            foundV = true;
+            break;
+        }
+    }
+    if (!foundV)
+        return false;
+
+    struct Node { int idx; cv::Point2f u, v; };
+    std::map<std::pair<int, int>, Node> grid;
+    std::vector<uchar> used(candidates.size(), 0);
+    std::vector<std::pair<int, int>> queue;
+    Node first = { seed, u, v };
+    grid[std::make_pair(0, 0)] = first;
+    used[seed] = 1;
+    queue.push_back(std::make_pair(0, 0));
+    int maxNodes = patternSize.area() * 2;
+    for (size_t q = 0; q < queue.size() && (int)grid.size() <= maxNodes; q++)
+    {
+        std::pair<int, int> key = queue[q];
+        Node node = grid[key];
+        cv::Point2f p = candidates[node.idx];
+        const int di[4] = { 0, 0, 1, -1 };
+        const int dj[4] = { 1, -1, 0, 0 };
+        for (int n = 0; n < 4; n++)
+        {
+            std::pair<int, int> next(key.first + di[n], key.second + dj[n]);
+            if (grid.count(next))
+                continue;
+            cv::Point2f step = (di[n] != 0) ? node.v * (float)di[n] : node.u * (float)dj[n];
+            float radius = (float)(0.3 * cv::norm(step));
+            int k = NearestCandidate(candidates, p + step, radius);
+            if (k < 0 || used[k])
+                continue;
+            // the local steps follow the perspective change across the board
+            Node child = node;
+            child.idx = k;
+            cv::Point2f actual = candidates[k] - p;
+            if (di[n] != 0)
+                child.v = actual * (float)di[n];
+            else
+                child.u = actual * (float)dj[n];
+            grid[next] = child;
+            used[k] = 1;
+            queue.push_back(next);
+        }
+    }
+
+    int iMin = 0, iMax = 0, jMin = 0, jMax = 0;
+    for (const auto& g : grid)
+    {
+        iMin = std::min(iMin, g.first.first);
+        iMax = std::max(iMax, g.first.first);
+        jMin = std::min(jMin, g.first.second);
+        jMax = std::max(jMax, g.first.second);
+    }
+    int rows = iMax - iMin + 1, cols = jMax - jMin + 1;
+    bool transposed;
+    if (rows == patternSize.height && cols == patternSize.width)
+        transposed = false;
+    else if (rows == patternSize.width && cols == patternSize.height)
+        transposed = true;
+    else
+        return false;
+    if ((int)grid.size() != patternSize.area())
+        return false;
+
+    // row-major order like findChessboardCorners, starting from the top-left-most end
+    corners.resize(patternSize.area());
+    for (const auto& g : grid)
+    {
+        int i = g.first.first - iMin, j = g.first.second - jMin;
+        int r = transposed ? j : i, c = transposed ? i : j;
+        corners[r * patternSize.width + c] = candidates[g.second.idx];
+    }
+    // the lattice axes may come out either way round : keep the handedness of findChessboardCorners
+    // ((p[W-1] - p[0]) x (p[W] - p[W-1]) >= 0), mirrored grids get each row reversed
+    int w = patternSize.width;
+    cv::Point2f a = corners[w - 1] - corners[0], b = corners[w] - corners[w - 1];
+    if (a.x * b.y - a.y * b.x < 0)
+    {
+        for (int r = 0; r < patternSize.height; r++)
+            std::reverse(corners.begin() + r * w, corners.begin() + (r + 1) * w);
+    }
+    // a 180 degree turn keeps the handedness
+    if (corners.front().x + corners.front().y > corners.back().x + corners.back().y)
+        std::reverse(corners.begin(), corners.end());
+    return true;
+}
+
+// Saddle-point chessboard detector : response map, candidates, then grid assembly.
+// The corners are on pixel centers of the working image, refine them with cornerSubPix.
+// stop(optional) : checked between the stages and the seeds, the detection gives up once it is set
+inline bool FindChessboardSaddle(const cv::Mat& gray, cv::Size patternSize, std::vector<cv::Point2f>& corners,
+    const SaddleDetectorParams& params = SaddleDetectorParams(), const std::atomic<bool>* stop = nullptr)
+{
+    cv::Mat work = gray;
+    float scale = 1.0f;
+    for (int l = 0; l < params.pyramidLevels; l++)
+    {
+        cv::pyrDown(work, work);
+        scale *= 2.0f;
+    }
+
+    cv::Mat response, smooth;
+    {
+        PROFILE_STAGE("saddle response");
+        SaddleResponse(work, params.sigma, response, smooth);
+    }
+    if (stop && *stop)
+        return false;
+    std::vector<cv::Point2f> candidates;
+    std::vector<float> strength;
+    SaddleCandidates(response, smooth, params, candidates, strength);
+    if ((int)candidates.size() < patternSize.area())
+        return false;
+
+    PROFILE_STAGE("saddle grid");
+    int seeds = std::min(params.maxSeeds, (int)candidates.size());
+    for (int s = 0; s < seeds; s++)
+    {
+        if (stop && *stop)
+            return false;
+        if (AssembleGrid(candidates, s, patternSize, corners))
+        {
+            for (cv::Point2f& p : corners)
+                p = p * scale;
+            return true;
+        }
+    }
+    return false;
+}
@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#define NOMINMAX
 #include <wtypes.h>
 
 #include <opencv2/core.hpp>
@@ -9,11 +10,24 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+#include "Stage_Profiler.h"
+#include "Calib_Common.h"
+#include "Stereo_Calibration.h"
+#include "Stereo_Disparity.h"
+#include "Camera_Model.h"
+#include "Charuco_Board.h"
+#include "Target_Detector.h"
+#include "Synthetic_Bench.h"
+#include "Multi_Board.h"
+#include "Coverage_Map.h"
+#include "Calib_Quality.h"
+#include "Batch_Runner.h"
+#include "Live_Pose.h"
+#include "Auto_Capture.h"
+
 using namespace std;
 using namespace cv;
 
-#define PATTERN_MAX      (80)   // # Number of the pattern images
-
 // Get the horizontal and vertical screen sizes in pixel
 void GetDesktopResolution(int& horizontal, int& vertical)
 {
@@ -29,27 +43,152 @@ void GetDesktopResolution(int& horizontal, int& vertical)
     vertical = desktop.bottom;
 }
 
-int main()
+// Write the stage timings when the program ends(enabled by --profile)
+void WriteProfileAtExit()
+{
+    StageProfiler& profiler = StageProfiler::Instance();
+    if (profiler.WriteJson("profile.json") && profiler.WriteChromeTrace("profile_trace.json"))
+        cout << "Stage timings are written to profile.json, profile_trace.json" << endl;
+}
+
+// Keep the learned detector order for the next run(enabled by --detector=race)
+void SaveDetectorRaceAtExit()
+{
+    GetDetectorRace().PrintStats();
+    GetDetectorRace().Save("detector_ladder.xml");
+}
+
+int main(int argc, char** argv)
 {
     int corner_count, found;
     int patternNum = 0;
     int boardRows = 0;
     int boardCols = 0;
     float boardSize = 0;
+    double liveFps = 30.0; // target rate of the live loop
+    string liveSource = "0"; // frame source of the live loop
+    double replayMB = REPLAY_MAX_MB; // memory for the recorded frames of the live replay
+    string captureDir; // where the acquire mode writes the kept frames
     
     vector<Mat> srcImg;
     vector<vector<Point2f>> imgPoints;
-    while (boardRows < 5 && boardCols < 5 && boardSize <= 10.0)
+    // counts the cv::Mat buffers when built with CALIB_COUNT_ALLOCS
+    InstallAllocationCounter();
+    // split the options(--xxx) from the mode arguments
+    vector<string> args;
+    for (int k = 1; k < argc; k++)
+    {
+        string arg = argv[k];
+        if (arg == "--profile")
+        {
+            StageProfiler::Instance().Enable(true);
+            atexit(WriteProfileAtExit);
+        }
+        else if (arg == "--subpix=adaptive")
+            GetSubPixSettings().adaptive = true;
+        else if (arg == "--subpix-engine=parallel")
+            GetSubPixSettings().engine = SUBPIX_ENGINE_PARALLEL;
+        else if (arg == "--pnp=planar")
+            GetPoseSolverSettings().solver = POSE_SOLVER_PLANAR;
+        else if (arg == "--detector=saddle")
+            GetChessboardSettings().engine = CHESSBOARD_ENGINE_SADDLE;
+        else if (arg == "--detector=race")
+        {
+            GetChessboardSettings().engine = CHESSBOARD_ENGINE_RACE;
+            GetDetectorRace().Load("detector_ladder.xml");
+            atexit(SaveDetectorRaceAtExit);
+        }
+        else if (arg == "--quality-gate")
+        {
+            GetFrameQualitySettings().enabled = true;
+            atexit(PrintFrameQualityStats);
+        }
+        else if (arg.compare(0, 16, "--min-sharpness=") == 0)
+            GetFrameQualitySettings().minSharpness = atof(arg.c_str() + 16);
+        else if (arg.compare(0, 16, "--max-saturated=") == 0)
+            GetFrameQualitySettings().maxSaturated = atof(arg.c_str() + 16);
+        else if (arg == "--dedup")
+            GetFrameDedupSettings().enabled = true;
+        else if (arg.compare(0, 17, "--dedup-distance=") == 0)
+            GetFrameDedupSettings().maxDistance = atof(arg.c_str() + 17);
+        else if (arg.compare(0, 11, "--live-fps=") == 0)
+            liveFps = atof(arg.c_str() + 11);
+        else if (arg.compare(0, 12, "--replay-mb=") == 0)
+            replayMB = atof(arg.c_str() + 12);
+        else if (arg.compare(0, 14, "--live-source=") == 0)
+            liveSource = arg.substr(14);
+        else if (arg.compare(0, 14, "--capture-dir=") == 0)
+            captureDir = arg.substr(14);
+        else if (arg.compare(0, 8, "--board=") == 0) // --board=7,10,25 : no prompt
+            sscanf(arg.c_str() + 8, "%d,%d,%f", &boardRows, &boardCols, &boardSize);
+        else
+            args.push_back(arg);
+    }
+    // select the calibration mode(default : mono)
+    string mode = (args.size() > 0) ? args[0] : "mono";
+    string modeOption = (args.size() > 1) ? args[1] : "";
+    // batch jobs carry their own board geometry
+    if (mode == "batch") // batch <manifest, default jobs.yml>
+        return RunBatchCalibration(modeOption.empty() ? "jobs.yml" : modeOption);
+
+    InputBoardGeometry(boardRows, boardCols, boardSize);
+    if (mode == "stereo")
+        return RunStereoCalibration(boardRows, boardCols, boardSize);
+    if (mode == "disparity")
+        return RunDisparityBenchmark(boardRows, boardCols);
+    if (mode == "model") // model pinhole | rational | omnidir | all
+        return RunCameraModelCalibration(boardRows, boardCols, boardSize, modeOption.empty() ? "all" : modeOption);
+    if (mode == "charuco") // charuco [print]
+    {
+        if (modeOption == "print")
+        {
+            SaveCharucoBoardImage("charuco_board.png", boardRows, boardCols);
+            return 0;
+        }
+        return RunCharucoCalibration(boardRows, boardCols, boardSize);
+    }
+    if (mode == "target") // target chessboard | saddle | circles[_asym][_cluster] | charuco | all
+        return RunTargetBenchmark(boardRows, boardCols, boardSize, modeOption.empty() ? "all" : modeOption);
+    if (mode == "video") // video <file | camera index>
+        return RunVideoCalibration(boardRows, boardCols, boardSize, modeOption.empty() ? "0" : modeOption);
+    if (mode == "live") // live <file | folder | camera index> : replay without a window
+        return RunLiveReplay(boardRows, boardCols, boardSize, modeOption.empty() ? "0" : modeOption, liveFps, replayMB);
+    if (mode == "acquire") // acquire <file | folder | camera index> : capture and calibrate in one pass
+        return RunAutoCapture(boardRows, boardCols, boardSize, modeOption.empty() ? "0" : modeOption, captureDir);
+    if (mode == "multi")
+        return RunMultiBoardCalibration(boardRows, boardCols, boardSize);
+    if (mode == "quality") // quality [force]
+        return RunQualityCalibration(boardRows, boardCols, boardSize, modeOption == "force");
+    if (mode == "bench") // bench [subpix | subpix-engine | detector | race | live-alloc | projection | fixed-board | pnp]
     {
-        std::cout << "Input the rows, columns and size(mm) of checkerboard(ex : 7 10 25) : ";
-        std::cin >> boardRows >> boardCols >> boardSize;
+        if (modeOption == "subpix")
+            return RunSubPixBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "subpix-engine")
+            return RunSubPixEngineBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "detector")
+            return RunDetectorBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "race")
+            return RunDetectorRaceBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "live-alloc")
+            return RunLiveAllocBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "projection")
+            return RunProjectionBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "fixed-board")
+            return RunFixedBoardBenchmark(boardRows, boardCols, boardSize);
+        if (modeOption == "pnp")
+            return RunPlanarPoseBenchmark(boardRows, boardCols, boardSize);
+        return RunSyntheticBenchmark(boardRows, boardCols, boardSize);
     }
 
     // load source images
     for (int i = 0; i < PATTERN_MAX; i++)
     {
         string path = "temp\\" + to_string(i) + ".jpg";
-        Mat src = imread(path);
+        Mat src;
+        {
+            PROFILE_STAGE("imread");
+            src = imread(path);
+        }
         if (i == 0 && src.empty())
             cout << "[Err] Failed to load source img file : " << path << endl;
         else if(i > 0 && src.empty())
@@ -84,19 +223,29 @@ int main()
     for (int i = 0; i < patternNum; i++)
     {
         Mat src_gray = Mat(srcImg[i].size(), CV_8UC1);
-        cvtColor(srcImg[i], src_gray, COLOR_BGR2GRAY);
+        {
+            PROFILE_STAGE("cvtColor");
+            cvtColor(srcImg[i], src_gray, COLOR_BGR2GRAY);
+        }
         // find coordinates of chessboard box
-        bool isCalibrated = findChessboardCorners(src_gray, pattern_size, corners);
+        bool isCalibrated = PassQualityGate(src_gray) && FindChessboard(src_gray, pattern_size, corners);
         if (isCalibrated)
         {
             cout << "[PASS] : " << i << ".jpg" << endl;
             found_num++;
+            PROFILE_COUNT("boards_found", 1);
         }
         else
+        {
+            // a frame rejected by the quality gate never reaches the detector, drop the previous corners
+            corners.clear();
             cout << "[FAIL] : " << i << ".jpg" << endl;
+            PROFILE_COUNT("boards_failed", 1);
+        }
 
         // calculate subpixel of corners with criteria
-        cornerSubPix(src_gray, corners, Size(10, 10), Size(-1, -1), TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.001)); 
+        if (isCalibrated)
+            RefineCorners(src_gray, corners, pattern_size);
 
         if (i == patternNum - 1) // show the result of calibration(only last image)
         {
@@ -110,14 +259,25 @@ int main()
                 showingMat = srcImg[i];
         }
         
-        imgPoints.push_back(corners);
+        // a failed view is skipped with its object points
+        if (isCalibrated)
+            imgPoints.push_back(corners);
+        else
+            objPoints.pop_back();
         if (i == patternNum - 1) // show the result of calibration(only last image)
         {
+            if (imgPoints.size() < 3)
+            {
+                cout << "[Err] Not enough views to calibrate" << endl;
+                return -1;
+            }
             Mat camIntrinsic; // camera intrinsic
             Mat camDistort; // lens distortion
             vector<Mat> camRotVec, camTransVec; // rotation vector and transfromation vector of each source image
-            calibrateCamera(objPoints, imgPoints, srcImg[0].size(), camIntrinsic, camDistort, camRotVec, camTransVec);
+            CalibQuality quality;
+            CalibrateWithUncertainty(objPoints, imgPoints, srcImg[0].size(), camIntrinsic, camDistort, camRotVec, camTransVec, 0, quality);
             cout << "===== Calibration Result =====" << endl;
+            PrintCalibQuality(quality);
             cout << "Camera intrinsic parameters :" << endl;
             cout << camIntrinsic << endl;
             cout << "Lens distortion coefficients :" << endl;
@@ -147,18 +307,25 @@ int main()
 
             cout << "keyyathow" << endl;
             cv::waitKey(6000);
-            solvePnPRansac(objPoints[i], corners, camIntrinsic, camDistort, rvec, tvec);
-            vector<Point2f> corners_rotated;
+            // the axis needs the board of the last image
+            if (isCalibrated)
+            {
+                {
+                    PROFILE_STAGE("solvePnPRansac");
+                    solvePnPRansac(objPoint, corners, camIntrinsic, camDistort, rvec, tvec);
+                }
+                vector<Point2f> corners_rotated;
 
-            vector<cv::Point3f> xyz;
-            xyz.push_back(Point3f(30, 0, 0));
-            xyz.push_back(Point3f(0, 30, 0));
-            xyz.push_back(Point3f(0, 0, 30));
+                vector<cv::Point3f> xyz;
+                xyz.push_back(Point3f(30, 0, 0));
+                xyz.push_back(Point3f(0, 30, 0));
+                xyz.push_back(Point3f(0, 0, 30));
 
-            projectPoints(xyz, rvec, tvec, camIntrinsic, camDistort, corners_rotated);
-            line(srcImg[i], corners[0], corners_rotated[0], Scalar(0, 0, 255), 5);
-            line(srcImg[i], corners[0], corners_rotated[1], Scalar(255, 0, 0), 5);
-            line(srcImg[i], corners[0], corners_rotated[2], Scalar(0, 255, 0), 5);
+                projectPoints(xyz, rvec, tvec, camIntrinsic, camDistort, corners_rotated);
+                line(srcImg[i], corners[0], corners_rotated[0], Scalar(0, 0, 255), 5);
+                line(srcImg[i], corners[0], corners_rotated[1], Scalar(255, 0, 0), 5);
+                line(srcImg[i], corners[0], corners_rotated[2], Scalar(0, 255, 0), 5);
+            }
 
             imshow("rotated", srcImg[i]);
             moveWindow("rotated", 10, 10);
@@ -166,44 +333,47 @@ int main()
             waitKey(0);
  
 
-            cv::VideoCapture Capture;
-            Capture.open(0);
-            Capture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('M', 'J', 'P', 'G'));
-            Capture.set(CV_CAP_PROP_FRAME_WIDTH, 1920);
-            Capture.set(CV_CAP_PROP_FRAME_HEIGHT, 1080);
+            cv::Ptr<FrameSource> Capture = CreateFrameSource(liveSource);
+            if (!Capture)
+                return -1;
             Mat showing;
             // # Drawing X,Y,Z axis of first corner (0, 0, 0)
-            bool isKeyInput = false;
-            while (Capture.read(showing))
+            // the live path reuses its buffers, so the steady state does not reallocate per frame
+            LivePoseTracker tracker(boardRows, boardCols, boardSize, camIntrinsic, camDistort);
+            // full, pyramid or tracking-only detection to stay within the frame budget
+            LiveScheduler scheduler(liveFps);
+            // recalibrates in the background when the reprojection error drifts(temperature, refocus).
+            // Created on the first live frame : the source resolution may differ from the calibration images.
+            cv::Ptr<DriftMonitor> drift;
+            int liveFrames = 0;
+            long long liveAllocs = 0;
+            int64 liveStart = getTickCount();
+            while (Capture->Read(showing))
             {
-                Mat grayimg = showing;
-                cvtColor(grayimg, src_gray, COLOR_BGR2GRAY);
-
-
-                //int keyinput_temp = waitKey(1);
-                //if (keyinput_temp == 13)
-                //{
-                //    if (isKeyInput == true)
-                //        isKeyInput = false;
-                //    else
-                //        isKeyInput = true;
-                //}
-                    
-
-              //  if (isKeyInput)
+                PROFILE_STAGE("live_frame");
+                PROFILE_COUNT("live_frames", 1);
+                long long allocBefore = AllocationCount();
+                int64 frameTick = getTickCount();
+                bool isTracked = tracker.Process(showing, scheduler.Mode());
+                scheduler.Update((getTickCount() - frameTick) * 1000.0 / getTickFrequency(), tracker.LastMode());
+                if (++liveFrames > 30) // after warm-up
+                    liveAllocs += AllocationCount() - allocBefore;
+                if (isTracked)
                 {
-                    if (findChessboardCorners(grayimg, pattern_size, corners))
-                    {
-                        solvePnPRansac(objPoints[i], corners, camIntrinsic, camDistort, rvec, tvec);
-                        projectPoints(xyz, rvec, tvec, camIntrinsic, camDistort, corners_rotated);
-                        line(showing, corners[0], corners_rotated[0], Scalar(0, 0, 255), 5);
-                        line(showing, corners[0], corners_rotated[1], Scalar(255, 0, 0), 5);
-                        line(showing, corners[0], corners_rotated[2], Scalar(0, 255, 0), 5);
-                    }
+                    if (!drift)
+                        drift = makePtr<DriftMonitor>(showing.size(), objPoint);
+                    drift->Update(tracker);
+                    tracker.DrawAxis(showing);
                 }
                 imshow("video", showing);
-                waitKey(1);
+                if (waitKey(1) == 27) // ESC
+                    break;
             }
+            scheduler.PrintStats((getTickCount() - liveStart) / getTickFrequency());
+            if (drift)
+                drift->PrintStats();
+            if (liveFrames > 30 && AllocationCount() >= 0)
+                cout << "Live allocations : " << (double)liveAllocs / (liveFrames - 30) << " per frame after warm-up" << endl;
 
         }
     }
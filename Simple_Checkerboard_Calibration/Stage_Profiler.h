@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/utility.hpp>
+
+// Scoped stage timers and counters.
+// Disabled by default : a disabled timer costs one relaxed atomic load.
+// Define CALIB_PROFILE_OFF to compile every probe out.
+class StageProfiler
+{
+public:
+    struct Event
+    {
+        const char* stage;
+        int64 start;                        // ticks
+        int64 end;
+        int tid;
+    };
+
+    static StageProfiler& Instance()
+    {
+        static StageProfiler profiler;
+        return profiler;
+    }
+
+    void Enable(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+    bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void AddEvent(const char* stage, int64 start, int64 end)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Event e = { stage, start, end, ThreadIndex() };
+        events_.push_back(e);
+    }
+
+    void AddCount(const char* counter, int64 value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters_[counter] += value;
+    }
+
+    void Reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+        counters_.clear();
+    }
+
+    // p50 / p99 / max / total(ms) of every stage, counters as is
+    bool WriteJson(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        std::map<std::string, std::vector<double>> durations;
+        double f = 1000.0 / cv::getTickFrequency();
+        for (const Event& e : events_)
+            durations[e.stage].push_back((e.end - e.start) * f);
+
+        out << "{\n  \"stages\": {";
+        bool first = true;
+        for (auto& d : durations)
+        {
+            std::vector<double>& v = d.second;
+            std::sort(v.begin(), v.end());
+            double total = 0.0;
+            for (double x : v)
+                total += x;
+            out << (first ? "\n" : ",\n") << "    \"" << d.first << "\": { \"count\": " << v.size()
+                << ", \"total_ms\": " << total << ", \"p50_ms\": " << Percentile(v, 0.50)
+                << ", \"p99_ms\": " << Percentile(v, 0.99) << ", \"max_ms\": " << v.back() << " }";
+            first = false;
+        }
+        out << "\n  },\n  \"counters\": {";
+        first = true;
+        for (auto& c : counters_)
+        {
+            out << (first ? "\n" : ",\n") << "    \"" << c.first << "\": " << c.second;
+            first = false;
+        }
+        out << "\n  }\n}\n";
+        return true;
+    }
+
+    // Chrome trace format(chrome://tracing, Perfetto)
+    bool WriteChromeTrace(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        double us = 1e6 / cv::getTickFrequency();
+        int64 origin = events_.empty() ? 0 : events_.front().start;
+        for (const Event& e : events_)
+            origin = std::min(origin, e.start);
+
+        out << "{\"traceEvents\":[";
+        for (size_t k = 0; k < events_.size(); k++)
+        {
+            const Event& e = events_[k];
+            out << (k ? ",\n" : "\n") << "{\"name\":\"" << e.stage << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+                << ",\"ts\":" << (e.start - origin) * us << ",\"dur\":" << (e.end - e.start) * us << "}";
+        }
+        out << "\n]}\n";
+        return true;
+    }
+
+private:
+    StageProfiler() : enabled_(false) {}
+
+    static double Percentile(const std::vector<double>& sorted, double q)
+    {
+        if (sorted.empty())
+            return 0.0;
+        size_t k = (size_t)(q * (sorted.size() - 1) + 0.5);
+        return sorted[k];
+    }
+
+    // small stable id per thread for the trace viewer(called with the lock held)
+    int ThreadIndex()
+    {
+        std::thread::id id = std::this_thread::get_id();
+        auto it = threadIds_.find(id);
+        if (it != threadIds_.end())
+            return it->second;
+        int index = (int)threadIds_.size();
+        threadIds_[id] = index;
+        return index;
+    }
+
+    std::atomic<bool> enabled_;
+    std::mutex mutex_;
+    std::vector<Event> events_;
+    std::map<std::string, int64> counters_;
+    std::map<std::thread::id, int> threadIds_;
+};
+
+class ScopedStageTimer
+{
+public:
+    explicit ScopedStageTimer(const char* stage)
+        : stage_(StageProfiler::Instance().IsEnabled() ? stage : nullptr), start_(stage_ ? cv::getTickCount() : 0) {}
+
+    ~ScopedStageTimer()
+    {
+        if (stage_)
+            StageProfiler::Instance().AddEvent(stage_, start_, cv::getTickCount());
+    }
+
+private:
+    const char* stage_;
+    int64 start_;
+};
+
+#ifndef CALIB_PROFILE_OFF
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_STAGE(name) ScopedStageTimer PROFILE_CONCAT(stageTimer_, __LINE__)(name)
+#define PROFILE_COUNT(name, value) \
+    do { if (StageProfiler::Instance().IsEnabled()) StageProfiler::Instance().AddCount(name, value); } while (0)
+#else
+#define PROFILE_STAGE(name) ((void)0)
+#define PROFILE_COUNT(name, value) ((void)0)
+#endif
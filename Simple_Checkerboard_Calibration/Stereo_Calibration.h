@@ -0,0 +1,179 @@
+#pragma once
+
+#include <opencv2/core/utility.hpp>
+
+#include "Calib_Common.h"
+
+// Result of the stereo calibration and the rectification maps of both cameras
+struct StereoCalibResult
+{
+    double rms = 0.0;
+    cv::Size imageSize;
+    cv::Mat camIntrinsic[2], camDistort[2];
+    cv::Mat R, T, E, F;
+    cv::Mat perViewErrors;                  // (# of pairs x 2) RMS of left and right view
+    cv::Mat R1, R2, P1, P2, Q;
+    cv::Rect validRoi[2];
+    cv::Mat rectMap[2][2];                  // [camera][x/y] maps for cv::remap
+};
+
+// Detect corners on all left/right pairs in parallel.
+// Only the pairs where both views are found are kept.
+inline int DetectStereoPairs(const std::vector<cv::Mat>& leftImg, const std::vector<cv::Mat>& rightImg,
+    cv::Size patternSize, std::vector<std::vector<cv::Point2f>>& leftPoints, std::vector<std::vector<cv::Point2f>>& rightPoints)
+{
+    int pairNum = (int)std::min(leftImg.size(), rightImg.size());
+    std::vector<std::vector<cv::Point2f>> corners(pairNum * 2);
+    std::vector<uchar> found(pairNum * 2, 0);
+
+    // one job per view, so both cameras of a pair are also detected concurrently
+    cv::parallel_for_(cv::Range(0, pairNum * 2), [&](const cv::Range& range)
+    {
+        for (int k = range.start; k < range.end; k++)
+        {
+            const cv::Mat& src = (k % 2 == 0) ? leftImg[k / 2] : rightImg[k / 2];
+            found[k] = DetectChessboard(src, patternSize, corners[k]) ? 1 : 0;
+        }
+    });
+
+    leftPoints.clear();
+    rightPoints.clear();
+    for (int i = 0; i < pairNum; i++)
+    {
+        if (found[i * 2] && found[i * 2 + 1])
+        {
+            std::cout << "[PASS] : pair " << i << std::endl;
+            leftPoints.push_back(corners[i * 2]);
+            rightPoints.push_back(corners[i * 2 + 1]);
+        }
+        else
+        {
+            std::cout << "[FAIL] : pair " << i;
+            if (found[i * 2] != found[i * 2 + 1])
+                std::cout << (found[i * 2] ? " (right)" : " (left)");
+            std::cout << std::endl;
+        }
+    }
+    return (int)leftPoints.size();
+}
+
+// Calibrate both cameras, then rectify the rig and precompute the remap tables
+inline bool StereoCalibrateRig(const std::vector<std::vector<cv::Point3f>>& objPoints,
+    const std::vector<std::vector<cv::Point2f>>& leftPoints, const std::vector<std::vector<cv::Point2f>>& rightPoints,
+    cv::Size imageSize, StereoCalibResult& result)
+{
+    if (objPoints.size() < 3)
+    {
+        std::cout << "[Err] Not enough stereo pairs : " << objPoints.size() << std::endl;
+        return false;
+    }
+    result.imageSize = imageSize;
+
+    // a mono calibration of each camera gives a good initial guess to the stereo solver
+    std::vector<cv::Mat> rvecs, tvecs;
+    cv::calibrateCamera(objPoints, leftPoints, imageSize, result.camIntrinsic[0], result.camDistort[0], rvecs, tvecs);
+    cv::calibrateCamera(objPoints, rightPoints, imageSize, result.camIntrinsic[1], result.camDistort[1], rvecs, tvecs);
+
+    PROFILE_STAGE("stereoCalibrate");
+    result.rms = cv::stereoCalibrate(objPoints, leftPoints, rightPoints,
+        result.camIntrinsic[0], result.camDistort[0], result.camIntrinsic[1], result.camDistort[1],
+        imageSize, result.R, result.T, result.E, result.F, result.perViewErrors,
+        cv::CALIB_USE_INTRINSIC_GUESS,
+        cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-6));
+
+    cv::stereoRectify(result.camIntrinsic[0], result.camDistort[0], result.camIntrinsic[1], result.camDistort[1],
+        imageSize, result.R, result.T, result.R1, result.R2, result.P1, result.P2, result.Q,
+        cv::CALIB_ZERO_DISPARITY, 0, imageSize, &result.validRoi[0], &result.validRoi[1]);
+
+    // CV_16SC2 maps are the fastest layout for cv::remap
+    cv::initUndistortRectifyMap(result.camIntrinsic[0], result.camDistort[0], result.R1, result.P1,
+        imageSize, CV_16SC2, result.rectMap[0][0], result.rectMap[0][1]);
+    cv::initUndistortRectifyMap(result.camIntrinsic[1], result.camDistort[1], result.R2, result.P2,
+        imageSize, CV_16SC2, result.rectMap[1][0], result.rectMap[1][1]);
+    return true;
+}
+
+// Rectify a left/right pair with the precomputed maps
+inline void RectifyStereoPair(const StereoCalibResult& result, const cv::Mat& left, const cv::Mat& right,
+    cv::Mat& leftRect, cv::Mat& rightRect)
+{
+    PROFILE_STAGE("remap");
+    cv::remap(left, leftRect, result.rectMap[0][0], result.rectMap[0][1], cv::INTER_LINEAR);
+    cv::remap(right, rightRect, result.rectMap[1][0], result.rectMap[1][1], cv::INTER_LINEAR);
+}
+
+inline void SaveStereoCalibration(const std::string& path, const StereoCalibResult& result)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    fs << "image_size" << result.imageSize;
+    fs << "intrinsic_left" << result.camIntrinsic[0] << "distortion_left" << result.camDistort[0];
+    fs << "intrinsic_right" << result.camIntrinsic[1] << "distortion_right" << result.camDistort[1];
+    fs << "R" << result.R << "T" << result.T << "E" << result.E << "F" << result.F;
+    fs << "R1" << result.R1 << "R2" << result.R2 << "P1" << result.P1 << "P2" << result.P2 << "Q" << result.Q;
+    fs << "valid_roi_left" << result.validRoi[0] << "valid_roi_right" << result.validRoi[1];
+    fs << "rms" << result.rms << "per_view_errors" << result.perViewErrors;
+}
+
+// Rebuild the rectification maps from a file written by SaveStereoCalibration
+inline bool LoadStereoCalibration(const std::string& path, StereoCalibResult& result)
+{
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened())
+        return false;
+    fs["image_size"] >> result.imageSize;
+    fs["intrinsic_left"] >> result.camIntrinsic[0];
+    fs["distortion_left"] >> result.camDistort[0];
+    fs["intrinsic_right"] >> result.camIntrinsic[1];
+    fs["distortion_right"] >> result.camDistort[1];
+    fs["R"] >> result.R;
+    fs["T"] >> result.T;
+    fs["E"] >> result.E;
+    fs["F"] >> result.F;
+    fs["R1"] >> result.R1;
+    fs["R2"] >> result.R2;
+    fs["P1"] >> result.P1;
+    fs["P2"] >> result.P2;
+    fs["Q"] >> result.Q;
+    fs["valid_roi_left"] >> result.validRoi[0];
+    fs["valid_roi_right"] >> result.validRoi[1];
+    fs["rms"] >> result.rms;
+    if (result.P1.empty() || result.P2.empty())
+        return false;
+
+    cv::initUndistortRectifyMap(result.camIntrinsic[0], result.camDistort[0], result.R1, result.P1,
+        result.imageSize, CV_16SC2, result.rectMap[0][0], result.rectMap[0][1]);
+    cv::initUndistortRectifyMap(result.camIntrinsic[1], result.camDistort[1], result.R2, result.P2,
+        result.imageSize, CV_16SC2, result.rectMap[1][0], result.rectMap[1][1]);
+    return true;
+}
+
+// Stereo mode : temp\left\N.jpg and temp\right\N.jpg are the image pairs
+inline int RunStereoCalibration(int boardRows, int boardCols, float boardSize)
+{
+    std::vector<cv::Mat> leftImg = LoadPatternImages("temp\\left\\");
+    std::vector<cv::Mat> rightImg = LoadPatternImages("temp\\right\\");
+    if (leftImg.empty() || rightImg.empty())
+        return -1;
+    if (leftImg.size() != rightImg.size())
+        std::cout << "[Warn] Number of left/right images differ : " << leftImg.size() << " / " << rightImg.size() << std::endl;
+
+    cv::Size patternSize(boardCols, boardRows);
+    std::vector<std::vector<cv::Point2f>> leftPoints, rightPoints;
+    int64 tick = cv::getTickCount();
+    int pairNum = DetectStereoPairs(leftImg, rightImg, patternSize, leftPoints, rightPoints);
+    double detectMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+    std::cout << "Detected pairs : " << pairNum << " (" << detectMs << " ms)" << std::endl;
+
+    std::vector<std::vector<cv::Point3f>> objPoints(pairNum, BuildObjectPoint(boardRows, boardCols, boardSize));
+    StereoCalibResult result;
+    if (!StereoCalibrateRig(objPoints, leftPoints, rightPoints, leftImg[0].size(), result))
+        return -1;
+
+    std::cout << "===== Stereo Calibration Result =====" << std::endl;
+    std::cout << "RMS : " << result.rms << std::endl;
+    std::cout << "Per-view errors (left, right) :" << std::endl << result.perViewErrors << std::endl;
+    std::cout << "R :" << std::endl << result.R << std::endl;
+    std::cout << "T :" << std::endl << result.T << std::endl;
+    SaveStereoCalibration("stereo.xml", result);
+    return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include "Stereo_Calibration.h"
+
+// Latency(ms) of each stage of the last processed pair
+struct DisparityTiming
+{
+    double gray = 0.0;
+    double remap = 0.0;
+    double match = 0.0;
+    double total = 0.0;
+};
+
+// Rectify a stereo pair with the cached maps and compute the disparity in horizontal tiles.
+// Each tile keeps the full image width, so the disparity search range is never cut.
+class StereoDisparityPipeline
+{
+public:
+    StereoDisparityPipeline(const StereoCalibResult& calib, int numDisparities = 64, int blockSize = 21, int tileNum = 0)
+        : calib_(calib), numDisparities_(numDisparities), blockSize_(blockSize)
+    {
+        tileNum_ = (tileNum > 0) ? tileNum : std::max(1, cv::getNumThreads());
+        // StereoBM keeps internal buffers, so every tile owns its matcher
+        for (int t = 0; t < tileNum_; t++)
+            matchers_.push_back(cv::StereoBM::create(numDisparities_, blockSize_));
+    }
+
+    void Process(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity)
+    {
+        int64 t0 = cv::getTickCount();
+        if (left.channels() == 1)
+        {
+            gray_[0] = left;
+            gray_[1] = right;
+        }
+        else
+        {
+            cv::cvtColor(left, gray_[0], cv::COLOR_BGR2GRAY);
+            cv::cvtColor(right, gray_[1], cv::COLOR_BGR2GRAY);
+        }
+        int64 t1 = cv::getTickCount();
+        RectifyStereoPair(calib_, gray_[0], gray_[1], rect_[0], rect_[1]);
+        int64 t2 = cv::getTickCount();
+
+        disparity.create(rect_[0].size(), CV_16S);
+        int rows = rect_[0].rows;
+        // the prefilter also reads across the band edge before the block matching does
+        int margin = blockSize_ / 2 + matchers_[0]->getPreFilterSize() / 2;
+        cv::parallel_for_(cv::Range(0, tileNum_), [&](const cv::Range& range)
+        {
+            for (int t = range.start; t < range.end; t++)
+            {
+                int y0 = rows * t / tileNum_;
+                int y1 = rows * (t + 1) / tileNum_;
+                // add the margin above/below so the tile borders match the full image result
+                int top = std::max(0, y0 - margin);
+                int bottom = std::min(rows, y1 + margin);
+                cv::Range band(top, bottom);
+                PROFILE_STAGE("StereoBM tile");
+                cv::Mat tileDisp;
+                matchers_[t]->compute(rect_[0].rowRange(band), rect_[1].rowRange(band), tileDisp);
+                tileDisp.rowRange(y0 - top, y1 - top).copyTo(disparity.rowRange(y0, y1));
+            }
+        }, tileNum_);
+        int64 t3 = cv::getTickCount();
+
+        double f = 1000.0 / cv::getTickFrequency();
+        timing_.gray = (t1 - t0) * f;
+        timing_.remap = (t2 - t1) * f;
+        timing_.match = (t3 - t2) * f;
+        timing_.total = (t3 - t0) * f;
+    }
+
+    const cv::Mat& RectifiedLeft() const { return rect_[0]; }
+    const cv::Mat& RectifiedRight() const { return rect_[1]; }
+    const DisparityTiming& Timing() const { return timing_; }
+
+private:
+    const StereoCalibResult& calib_;
+    int numDisparities_;
+    int blockSize_;
+    int tileNum_;
+    std::vector<cv::Ptr<cv::StereoBM>> matchers_;
+    cv::Mat gray_[2], rect_[2];
+    DisparityTiming timing_;
+};
+
+// Mean absolute row difference of the board corners in a rectified pair(0 for a perfect rig)
+inline double EpipolarAlignmentError(const cv::Mat& leftRect, const cv::Mat& rightRect, cv::Size patternSize)
+{
+    std::vector<cv::Point2f> leftCorners, rightCorners;
+    if (!DetectChessboard(leftRect, patternSize, leftCorners) || !DetectChessboard(rightRect, patternSize, rightCorners))
+        return -1.0;
+    double err = 0.0;
+    for (size_t k = 0; k < leftCorners.size(); k++)
+        err += std::abs(leftCorners[k].y - rightCorners[k].y);
+    return err / leftCorners.size();
+}
+
+// Disparity mode : replay the pairs of temp\left\ and temp\right\ through the pipeline with stereo.xml
+inline int RunDisparityBenchmark(int boardRows, int boardCols, int repeat = 20)
+{
+    StereoCalibResult calib;
+    if (!LoadStereoCalibration("stereo.xml", calib))
+    {
+        std::cout << "[Err] Failed to load stereo.xml, run the stereo mode first" << std::endl;
+        return -1;
+    }
+    std::vector<cv::Mat> leftImg = LoadPatternImages("temp\\left\\");
+    std::vector<cv::Mat> rightImg = LoadPatternImages("temp\\right\\");
+    size_t pairNum = std::min(leftImg.size(), rightImg.size());
+    if (pairNum == 0)
+        return -1;
+
+    StereoDisparityPipeline pipeline(calib);
+    cv::Size patternSize(boardCols, boardRows);
+    cv::Mat disparity;
+    DisparityTiming sum;
+    int frames = 0;
+    double alignSum = 0.0;
+    int alignNum = 0;
+    int64 start = cv::getTickCount();
+    for (int r = 0; r < repeat; r++)
+    {
+        for (size_t i = 0; i < pairNum; i++)
+        {
+            pipeline.Process(leftImg[i], rightImg[i], disparity);
+            const DisparityTiming& t = pipeline.Timing();
+            sum.gray += t.gray;
+            sum.remap += t.remap;
+            sum.match += t.match;
+            sum.total += t.total;
+            frames++;
+
+            // the alignment does not change between repeats
+            if (r == 0)
+            {
+                double err = EpipolarAlignmentError(pipeline.RectifiedLeft(), pipeline.RectifiedRight(), patternSize);
+                if (err >= 0.0)
+                {
+                    alignSum += err;
+                    alignNum++;
+                }
+            }
+        }
+        // keep the alignment check out of the throughput
+        if (r == 0)
+            start = cv::getTickCount();
+    }
+    double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+    int timedFrames = frames - (int)pairNum;
+
+    std::cout << "===== Disparity Benchmark =====" << std::endl;
+    std::cout << "Pairs : " << pairNum << ", frames : " << frames << std::endl;
+    std::cout << "Mean latency(ms) gray / remap / match / total : "
+        << sum.gray / frames << " / " << sum.remap / frames << " / " << sum.match / frames << " / " << sum.total / frames << std::endl;
+    if (timedFrames > 0)
+        std::cout << "Throughput : " << timedFrames / elapsed << " pairs/s" << std::endl;
+    if (alignNum > 0)
+        std::cout << "Epipolar alignment error : " << alignSum / alignNum << " px (" << alignNum << " pairs)" << std::endl;
+    else
+        std::cout << "Epipolar alignment error : board not found in rectified pairs" << std::endl;
+    return 0;
+}
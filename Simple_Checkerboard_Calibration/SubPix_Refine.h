@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Stage_Profiler.h"
+
+#define SUBPIX_FIXED_WINDOW      (10)   // # Half window of the fixed refinement(21x21 patch)
+#define SUBPIX_MIN_WINDOW        (2)
+
+enum SubPixEngine
+{
+    SUBPIX_ENGINE_OPENCV = 0,               // cv::cornerSubPix
+    SUBPIX_ENGINE_PARALLEL = 1              // CornerSubPixParallel(corners across threads, SIMD gradient sums)
+};
+
+// Corner refinement settings shared by every detection path
+struct SubPixSettings
+{
+    int engine = SUBPIX_ENGINE_OPENCV;
+    bool adaptive = false;                  // size the window from the square pitch of each view
+    double windowRatio = 0.4;               // half window / smallest corner spacing(< 0.5 never reaches the next corner)
+    int maxIter = 30;
+    double epsilon = 0.001;                 // per-corner stop : the corner moved less than this(px)
+};
+
+inline SubPixSettings& GetSubPixSettings()
+{
+    static SubPixSettings settings;
+    return settings;
+}
+
+// Smallest distance between neighboring corners of the grid(px)
+inline double MinCornerSpacing(const std::vector<cv::Point2f>& corners, cv::Size patternSize)
+{
+    double minSpacing = 1e9;
+    for (int r = 0; r < patternSize.height; r++)
+    {
+        for (int c = 0; c < patternSize.width; c++)
+        {
+            const cv::Point2f& p = corners[r * patternSize.width + c];
+            if (c + 1 < patternSize.width)
+                minSpacing = std::min(minSpacing, (double)cv::norm(p - corners[r * patternSize.width + c + 1]));
+            if (r + 1 < patternSize.height)
+                minSpacing = std::min(minSpacing, (double)cv::norm(p - corners[(r + 1) * patternSize.width + c]));
+        }
+    }
+    return minSpacing;
+}
+
+// Half window that stays inside the squares around the corner
+inline cv::Size AdaptiveSubPixWindow(const std::vector<cv::Point2f>& corners, cv::Size patternSize, double windowRatio)
+{
+    if ((int)corners.size() != patternSize.area())
+        return cv::Size(SUBPIX_FIXED_WINDOW, SUBPIX_FIXED_WINDOW);
+    int half = (int)std::floor(MinCornerSpacing(corners, patternSize) * windowRatio);
+    half = std::max(SUBPIX_MIN_WINDOW, std::min(SUBPIX_FIXED_WINDOW, half));
+    return cv::Size(half, half);
+}
+
+// Weighted gradient sums of one window for the corner equation.
+// subpix is the (win_w + 2) x (win_h + 2) patch, px[j] = j - win.width.
+inline void AccumulateCornerGradients(const float* subpix, const float* mask, const float* px,
+    int win_w, int win_h, int half_h, double& a, double& b, double& c, double& bb1, double& bb2)
+{
+    const int stride = win_w + 2;
+    a = b = c = bb1 = bb2 = 0.0;
+    for (int i = 0; i < win_h; i++)
+    {
+        const float* row = subpix + (i + 1) * stride + 1;
+        const float* m = mask + i * win_w;
+        double py = i - half_h;
+        // per row : sum(gxx), sum(gxy), sum(gyy), sum(gxx * px), sum(gxy * px)
+        double sxx = 0.0, sxy = 0.0, syy = 0.0, sxxp = 0.0, sxyp = 0.0;
+        int j = 0;
+#if CV_SIMD
+        const int lanes = cv::v_float32::nlanes;
+        cv::v_float32 vxx = cv::vx_setzero_f32(), vxy = cv::vx_setzero_f32(), vyy = cv::vx_setzero_f32();
+        cv::v_float32 vxxp = cv::vx_setzero_f32(), vxyp = cv::vx_setzero_f32();
+        for (; j <= win_w - lanes; j += lanes)
+        {
+            cv::v_float32 tgx = cv::vx_load(row + j + 1) - cv::vx_load(row + j - 1);
+            cv::v_float32 tgy = cv::vx_load(row + j + stride) - cv::vx_load(row + j - stride);
+            cv::v_float32 vm = cv::vx_load(m + j);
+            cv::v_float32 vpx = cv::vx_load(px + j);
+            cv::v_float32 gxx = tgx * tgx * vm;
+            cv::v_float32 gxy = tgx * tgy * vm;
+            vxx += gxx;
+            vxy += gxy;
+            vyy = cv::v_muladd(tgy * tgy, vm, vyy);
+            vxxp = cv::v_muladd(gxx, vpx, vxxp);
+            vxyp = cv::v_muladd(gxy, vpx, vxyp);
+        }
+        sxx = cv::v_reduce_sum(vxx);
+        sxy = cv::v_reduce_sum(vxy);
+        syy = cv::v_reduce_sum(vyy);
+        sxxp = cv::v_reduce_sum(vxxp);
+        sxyp = cv::v_reduce_sum(vxyp);
+#endif
+        for (; j < win_w; j++)
+        {
+            double tgx = row[j + 1] - row[j - 1];
+            double tgy = row[j + stride] - row[j - stride];
+            double gxx = tgx * tgx * m[j];
+            double gxy = tgx * tgy * m[j];
+            sxx += gxx;
+            sxy += gxy;
+            syy += tgy * tgy * m[j];
+            sxxp += gxx * px[j];
+            sxyp += gxy * px[j];
+        }
+        a += sxx;
+        b += sxy;
+        c += syy;
+        bb1 += sxxp + sxy * py;
+        bb2 += sxyp + syy * py;
+    }
+}
+
+// Drop-in replacement of cv::cornerSubPix : same window, mask and stop rule,
+// the corners are refined in parallel and the gradient sums use SIMD.
+inline void CornerSubPixParallel(const cv::Mat& gray, std::vector<cv::Point2f>& corners, cv::Size win, cv::Size zeroZone,
+    cv::TermCriteria criteria)
+{
+    CV_Assert(gray.type() == CV_8UC1 || gray.type() == CV_32FC1);
+    const int MAX_ITERS = 100;
+    int win_w = win.width * 2 + 1, win_h = win.height * 2 + 1;
+    int maxIters = (criteria.type & cv::TermCriteria::COUNT) ? std::min(std::max(criteria.maxCount, 1), MAX_ITERS) : MAX_ITERS;
+    double eps = (criteria.type & cv::TermCriteria::EPS) ? std::max(criteria.epsilon, 0.0) : 0.0;
+    eps *= eps;
+
+    // gaussian weights of the window, same as cv::cornerSubPix
+    std::vector<float> mask(win_w * win_h), px(win_w);
+    for (int i = 0; i < win_h; i++)
+    {
+        float y = (float)(i - win.height) / win.height;
+        float vy = std::exp(-y * y);
+        for (int j = 0; j < win_w; j++)
+        {
+            float x = (float)(j - win.width) / win.width;
+            mask[i * win_w + j] = (float)(vy * std::exp(-x * x));
+        }
+    }
+    for (int j = 0; j < win_w; j++)
+        px[j] = (float)(j - win.width);
+    if (zeroZone.width >= 0 && zeroZone.height >= 0 && zeroZone.width * 2 + 1 < win_w && zeroZone.height * 2 + 1 < win_h)
+    {
+        for (int i = win.height - zeroZone.height; i <= win.height + zeroZone.height; i++)
+        {
+            for (int j = win.width - zeroZone.width; j <= win.width + zeroZone.width; j++)
+                mask[i * win_w + j] = 0.0f;
+        }
+    }
+
+    int count = (int)corners.size();
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range)
+    {
+        cv::Mat subpixBuf(win_h + 2, win_w + 2, CV_32F);
+        for (int k = range.start; k < range.end; k++)
+        {
+            cv::Point2f cT = corners[k], cI = cT;
+            int iter = 0;
+            double err = 0.0;
+            do
+            {
+                cv::getRectSubPix(gray, cv::Size(win_w + 2, win_h + 2), cI, subpixBuf, CV_32F);
+                double a, b, c, bb1, bb2;
+                AccumulateCornerGradients(subpixBuf.ptr<float>(), mask.data(), px.data(), win_w, win_h, win.height, a, b, c, bb1, bb2);
+
+                double det = a * c - b * b;
+                if (std::fabs(det) <= DBL_EPSILON * DBL_EPSILON)
+                    break;
+                double scale = 1.0 / det;
+                cv::Point2f cI2((float)(cI.x + c * scale * bb1 - b * scale * bb2),
+                                (float)(cI.y - b * scale * bb1 + a * scale * bb2));
+                err = (cI2.x - cI.x) * (cI2.x - cI.x) + (cI2.y - cI.y) * (cI2.y - cI.y);
+                cI = cI2;
+                if (cI.x < 0 || cI.x >= gray.cols || cI.y < 0 || cI.y >= gray.rows)
+                    break;
+            } while (++iter < maxIters && err > eps);
+
+            // too far from the initial point means poor convergence : keep the initial point
+            if (std::fabs(cI.x - cT.x) > win.width || std::fabs(cI.y - cT.y) > win.height)
+                cI = cT;
+            corners[k] = cI;
+        }
+    }, std::max(1.0, count / 16.0));
+}
+
+// Refine the detected corners to subpixel with the current settings
+inline void RefineCorners(const cv::Mat& gray, std::vector<cv::Point2f>& corners, cv::Size patternSize,
+    const SubPixSettings& settings = GetSubPixSettings())
+{
+    PROFILE_STAGE("cornerSubPix");
+    cv::Size window(SUBPIX_FIXED_WINDOW, SUBPIX_FIXED_WINDOW);
+    if (settings.adaptive)
+        window = AdaptiveSubPixWindow(corners, patternSize, settings.windowRatio);
+    cv::TermCriteria criteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, settings.maxIter, settings.epsilon);
+    if (settings.engine == SUBPIX_ENGINE_PARALLEL)
+        CornerSubPixParallel(gray, corners, window, cv::Size(-1, -1), criteria);
+    else
+        cv::cornerSubPix(gray, corners, window, cv::Size(-1, -1), criteria);
+}
@@ -0,0 +1,740 @@
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+
+#include "Calib_Common.h"
+#include "Live_Pose.h"
+#include "Alloc_Counter.h"
+#include "Projection_Kernels.h"
+#include "Fixed_Board.h"
+#include "Planar_Pose.h"
+
+#pragma comment(lib, "psapi.lib")
+
+#define BENCH_MISORDER_PX (3.0)     // # Corner error(px) above which a detected view has a wrong corner order
+
+// One synthetic scene set : known camera, board and image degradations
+struct SyntheticConfig
+{
+    std::string name;
+    cv::Size imageSize = cv::Size(1920, 1080);
+    int viewNum = 20;
+    double noiseSigma = 0.0;                // gaussian noise(gray levels)
+    double blurSigma = 0.0;                 // gaussian blur(px)
+    double lightGradient = 0.0;             // 0 ~ 1, left-to-right falloff of the illumination
+    uint64 seed = 12345;
+};
+
+struct SyntheticCamera
+{
+    cv::Mat camIntrinsic;
+    cv::Mat camDistort;
+};
+
+// Peak working set of this process(MB)
+inline double PeakMemoryMB()
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0.0;
+    return pmc.PeakWorkingSetSize / (1024.0 * 1024.0);
+}
+
+// Camera close to the one of camera.xml(1080p, mild barrel distortion)
+inline SyntheticCamera DefaultSyntheticCamera(cv::Size imageSize)
+{
+    SyntheticCamera cam;
+    double f = imageSize.width * 0.6;
+    cam.camIntrinsic = (cv::Mat_<double>(3, 3) << f, 0, imageSize.width * 0.5, 0, f, imageSize.height * 0.5, 0, 0, 1);
+    cam.camDistort = (cv::Mat_<double>(1, 5) << 0.08, -0.08, 0.001, -0.001, 0.0);
+    return cam;
+}
+
+// Board texture in pixels : one square is pixelsPerSquare, one white square of margin around the corners
+inline cv::Mat RenderBoardTexture(int boardRows, int boardCols, int pixelsPerSquare)
+{
+    int squaresX = boardCols + 1, squaresY = boardRows + 1;
+    cv::Mat board(cv::Size((squaresX + 2) * pixelsPerSquare, (squaresY + 2) * pixelsPerSquare), CV_8UC1, cv::Scalar(255));
+    for (int y = 0; y < squaresY; y++)
+    {
+        for (int x = 0; x < squaresX; x++)
+        {
+            if ((x + y) % 2 == 0)
+                cv::rectangle(board, cv::Rect((x + 1) * pixelsPerSquare, (y + 1) * pixelsPerSquare, pixelsPerSquare, pixelsPerSquare),
+                    cv::Scalar(0), cv::FILLED);
+        }
+    }
+    return board;
+}
+
+// Remap table that applies the lens distortion to an ideal pinhole image
+inline void BuildDistortionMap(const SyntheticCamera& cam, cv::Size imageSize, cv::Mat& mapX, cv::Mat& mapY)
+{
+    std::vector<cv::Point2f> pixels;
+    pixels.reserve(imageSize.area());
+    for (int v = 0; v < imageSize.height; v++)
+    {
+        for (int u = 0; u < imageSize.width; u++)
+            pixels.push_back(cv::Point2f((float)u, (float)v));
+    }
+    // every distorted pixel samples the ideal image at its undistorted position
+    std::vector<cv::Point2f> ideal;
+    cv::undistortPoints(pixels, ideal, cam.camIntrinsic, cam.camDistort, cv::noArray(), cam.camIntrinsic);
+    mapX.create(imageSize, CV_32FC1);
+    mapY.create(imageSize, CV_32FC1);
+    for (int v = 0; v < imageSize.height; v++)
+    {
+        for (int u = 0; u < imageSize.width; u++)
+        {
+            const cv::Point2f& p = ideal[v * imageSize.width + u];
+            mapX.at<float>(v, u) = p.x;
+            mapY.at<float>(v, u) = p.y;
+        }
+    }
+}
+
+// Render the views with random poses that keep the board in the frame.
+// trueCorners are the exact distorted corner positions for the detection error, in the corner order of
+// findChessboardCorners(row-major with (p[W-1] - p[0]) x (p[W] - p[W-1]) >= 0, up to a 180 degree turn).
+inline void RenderSyntheticViews(const SyntheticConfig& config, const SyntheticCamera& cam,
+    int boardRows, int boardCols, float boardSize,
+    std::vector<cv::Mat>& views, std::vector<std::vector<cv::Point2f>>& trueCorners)
+{
+    const int pixelsPerSquare = 64;
+    cv::Mat texture = RenderBoardTexture(boardRows, boardCols, pixelsPerSquare);
+    cv::Mat mapX, mapY;
+    BuildDistortionMap(cam, config.imageSize, mapX, mapY);
+    std::vector<cv::Point3f> objPoint = BuildObjectPoint(boardRows, boardCols, boardSize);
+
+    // texture pixel -> board plane(mm) : the first inner corner is the board origin.
+    // BuildObjectPoint puts rows on X and columns on Y. Pixel centers are at integer coordinates,
+    // so the edge between texels 127 and 128 is at u = 127.5 : board = s * (u + 0.5) - 2 * boardSize.
+    double s = boardSize / pixelsPerSquare;
+    double offset = s * 0.5 - 2 * boardSize;
+    cv::Mat texToBoard = (cv::Mat_<double>(3, 3) << 0, s, offset, s, 0, offset, 0, 0, 1);
+
+    cv::RNG rng(config.seed);
+    double boardDiag = boardSize * std::sqrt((double)(boardRows * boardRows + boardCols * boardCols));
+    double fx = cam.camIntrinsic.at<double>(0, 0);
+    views.clear();
+    trueCorners.clear();
+    // give up when the board cannot fit the image(too many corners for the resolution)
+    for (int attempt = 0; (int)views.size() < config.viewNum && attempt < config.viewNum * 50; attempt++)
+    {
+        cv::Vec3d rvec(rng.uniform(-0.5, 0.5), rng.uniform(-0.5, 0.5), rng.uniform(-0.3, 0.3));
+        double z = fx * boardDiag / (config.imageSize.height * rng.uniform(0.5, 0.9));
+        cv::Vec3d tvec(-boardRows * boardSize * 0.5 + rng.uniform(-0.2, 0.2) * z,
+                       -boardCols * boardSize * 0.5 + rng.uniform(-0.1, 0.1) * z, z);
+
+        std::vector<cv::Point2f> corners;
+        cv::projectPoints(objPoint, rvec, tvec, cam.camIntrinsic, cam.camDistort, corners);
+        cv::Rect inner(20, 20, config.imageSize.width - 40, config.imageSize.height - 40);
+        bool inside = true;
+        for (const cv::Point2f& p : corners)
+            inside = inside && inner.contains(p);
+        if (!inside)
+            continue;
+
+        // board plane -> ideal image : K [r1 r2 t]
+        cv::Mat R;
+        cv::Rodrigues(rvec, R);
+        cv::Mat H(3, 3, CV_64F);
+        R.col(0).copyTo(H.col(0));
+        R.col(1).copyTo(H.col(1));
+        cv::Mat(tvec).copyTo(H.col(2));
+        H = cam.camIntrinsic * H * texToBoard;
+
+        cv::Mat ideal, view;
+        cv::warpPerspective(texture, ideal, H, config.imageSize, cv::INTER_AREA, cv::BORDER_CONSTANT, cv::Scalar(128));
+        cv::remap(ideal, view, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(128));
+
+        if (config.blurSigma > 0.0)
+            cv::GaussianBlur(view, view, cv::Size(), config.blurSigma);
+        if (config.lightGradient > 0.0)
+        {
+            cv::Mat gain(1, config.imageSize.width, CV_32F);
+            for (int u = 0; u < config.imageSize.width; u++)
+                gain.at<float>(0, u) = (float)(1.0 - config.lightGradient * u / config.imageSize.width);
+            cv::Mat viewF;
+            view.convertTo(viewF, CV_32F);
+            viewF = viewF.mul(cv::repeat(gain, config.imageSize.height, 1));
+            viewF.convertTo(view, CV_8U);
+        }
+        if (config.noiseSigma > 0.0)
+        {
+            cv::Mat noise(config.imageSize, CV_16S);
+            rng.fill(noise, cv::RNG::NORMAL, 0, config.noiseSigma);
+            cv::Mat view16;
+            view.convertTo(view16, CV_16S);
+            view16 += noise;
+            view16.convertTo(view, CV_8U);
+        }
+        // BuildObjectPoint puts the rows on X, which projects with the opposite handedness of the detectors
+        for (int r = 0; r < boardRows; r++)
+            std::reverse(corners.begin() + r * boardCols, corners.begin() + (r + 1) * boardCols);
+        views.push_back(view);
+        trueCorners.push_back(corners);
+    }
+}
+
+// Views of one bench mode with the default camera for its image size.
+// False, with the message, when the board does not fit the image.
+inline bool RenderBenchViews(const SyntheticConfig& config, int boardRows, int boardCols, float boardSize, SyntheticCamera& cam,
+    std::vector<cv::Mat>& views, std::vector<std::vector<cv::Point2f>>& trueCorners)
+{
+    cam = DefaultSyntheticCamera(config.imageSize);
+    RenderSyntheticViews(config, cam, boardRows, boardCols, boardSize, views, trueCorners);
+    if (views.empty())
+    {
+        std::cout << "[Err] " << config.name << " : board does not fit in " << config.imageSize << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Align the detected grid to the rendered one(the detector may start from either end)
+inline void AlignToTruth(std::vector<cv::Point2f>& corners, const std::vector<cv::Point2f>& truth)
+{
+    if (cv::norm(corners.front() - truth.front()) > cv::norm(corners.front() - truth.back()))
+        std::reverse(corners.begin(), corners.end());
+}
+
+inline double MeanCornerError(const std::vector<std::vector<cv::Point2f>>& corners, const std::vector<std::vector<cv::Point2f>>& truth)
+{
+    double err = 0.0;
+    int num = 0;
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        for (size_t k = 0; k < corners[i].size(); k++)
+            err += cv::norm(corners[i][k] - truth[i][k]);
+        num += (int)corners[i].size();
+    }
+    return num ? err / num : 0.0;
+}
+
+// True when every found view has the corner order of the truth
+inline bool PrintMisordered(int misorderedNum)
+{
+    if (misorderedNum > 0)
+        std::cout << "    [FAIL] : " << misorderedNum << " view(s) with a wrong corner order" << std::endl;
+    return misorderedNum == 0;
+}
+
+// Run detection, subpixel refinement and calibration on one scene set and print the report line.
+// A view with a corner farther than BENCH_MISORDER_PX from the truth has a wrong corner order(mirrored or shifted grid) :
+// it is left out of the calibration and fails the scene.
+inline bool RunSyntheticScene(const SyntheticConfig& config, int boardRows, int boardCols, float boardSize)
+{
+    SyntheticCamera cam;
+    std::vector<cv::Mat> views;
+    std::vector<std::vector<cv::Point2f>> trueCorners;
+    if (!RenderBenchViews(config, boardRows, boardCols, boardSize, cam, views, trueCorners))
+        return false;
+
+    cv::Size patternSize(boardCols, boardRows);
+    double f = 1000.0 / cv::getTickFrequency();
+    double detectMs = 0.0, subpixMs = 0.0, cornerErr = 0.0;
+    int cornerNum = 0, misorderedNum = 0;
+    std::vector<std::vector<cv::Point2f>> imgPoints;
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        std::vector<cv::Point2f> corners;
+        int64 t0 = cv::getTickCount();
+        bool found = FindChessboard(views[i], patternSize, corners);
+        int64 t1 = cv::getTickCount();
+        detectMs += (t1 - t0) * f;
+        if (!found)
+            continue;
+        RefineCorners(views[i], corners, patternSize);
+        subpixMs += (cv::getTickCount() - t1) * f;
+
+        const std::vector<cv::Point2f>& truth = trueCorners[i];
+        AlignToTruth(corners, truth);
+        double viewErr = 0.0, maxErr = 0.0;
+        for (size_t k = 0; k < corners.size(); k++)
+        {
+            double err = cv::norm(corners[k] - truth[k]);
+            viewErr += err;
+            maxErr = std::max(maxErr, err);
+        }
+        if (maxErr > BENCH_MISORDER_PX)
+        {
+            misorderedNum++;
+            continue;
+        }
+        cornerErr += viewErr;
+        cornerNum += (int)corners.size();
+        imgPoints.push_back(corners);
+    }
+
+    std::cout << "[" << config.name << "] found : " << imgPoints.size() << " / " << views.size()
+        << ", detect : " << detectMs / views.size() << " ms/view"
+        << ", subpix : " << (imgPoints.empty() ? 0.0 : subpixMs / imgPoints.size()) << " ms/view";
+    if (cornerNum > 0)
+        std::cout << ", corner err : " << cornerErr / cornerNum << " px";
+    if (imgPoints.size() < 3)
+    {
+        std::cout << ", not enough views to calibrate" << std::endl;
+        return PrintMisordered(misorderedNum);
+    }
+
+    std::vector<std::vector<cv::Point3f>> objPoints(imgPoints.size(), BuildObjectPoint(boardRows, boardCols, boardSize));
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    int64 t = cv::getTickCount();
+    double rms = cv::calibrateCamera(objPoints, imgPoints, config.imageSize, camIntrinsic, camDistort, camRotVec, camTransVec);
+    double calibMs = (cv::getTickCount() - t) * f;
+    double totalMs = detectMs + subpixMs + calibMs;
+
+    const cv::Mat& K = cam.camIntrinsic;
+    double focalErr = std::max(std::abs(camIntrinsic.at<double>(0, 0) - K.at<double>(0, 0)),
+                               std::abs(camIntrinsic.at<double>(1, 1) - K.at<double>(1, 1)));
+    double centerErr = cv::norm(cv::Point2d(camIntrinsic.at<double>(0, 2) - K.at<double>(0, 2),
+                                            camIntrinsic.at<double>(1, 2) - K.at<double>(1, 2)));
+    double distortErr = cv::norm(camDistort.colRange(0, 5) - cam.camDistort, cv::NORM_INF);
+
+    std::cout << ", calib : " << calibMs << " ms, rms : " << rms << " px" << std::endl;
+    std::cout << "    throughput : " << views.size() * 1000.0 / totalMs << " views/s"
+        << ", focal err : " << focalErr << " px, center err : " << centerErr << " px"
+        << ", distortion err(inf) : " << distortErr
+        << ", peak memory : " << PeakMemoryMB() << " MB" << std::endl;
+    return PrintMisordered(misorderedNum);
+}
+
+// Scene sets of the benchmark : clean and each degradation alone and mixed
+inline std::vector<SyntheticConfig> DefaultSyntheticConfigs()
+{
+    std::vector<SyntheticConfig> configs(5);
+    configs[0].name = "clean";
+    configs[1].name = "noise";
+    configs[1].noiseSigma = 8.0;
+    configs[2].name = "blur";
+    configs[2].blurSigma = 2.0;
+    configs[3].name = "lighting";
+    configs[3].lightGradient = 0.7;
+    configs[4].name = "mixed";
+    configs[4].noiseSigma = 5.0;
+    configs[4].blurSigma = 1.5;
+    configs[4].lightGradient = 0.5;
+    for (size_t c = 0; c < configs.size(); c++)
+        configs[c].seed += c;
+    return configs;
+}
+
+// Bench mode : fixed seeds, so every run renders the same views
+inline int RunSyntheticBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    std::vector<SyntheticConfig> configs = DefaultSyntheticConfigs();
+    std::cout << "===== Synthetic Benchmark (" << boardRows << " x " << boardCols << ", " << boardSize << " mm) =====" << std::endl;
+    bool ordered = true;
+    for (size_t c = 0; c < configs.size(); c++)
+        ordered = RunSyntheticScene(configs[c], boardRows, boardCols, boardSize) && ordered;
+    return ordered ? 0 : -1;
+}
+
+// Bench detector mode : the same scene sets with each chessboard engine
+inline int RunDetectorBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    const char* engineNames[2] = { "opencv", "saddle" };
+    ChessboardSettings saved = GetChessboardSettings();
+    bool ordered = true;
+    std::cout << "===== Detector Benchmark (" << boardRows << " x " << boardCols << ", " << boardSize << " mm) =====" << std::endl;
+    for (int e = 0; e < 2; e++)
+    {
+        GetChessboardSettings().engine = e;
+        std::vector<SyntheticConfig> configs = DefaultSyntheticConfigs();
+        for (size_t c = 0; c < configs.size(); c++)
+        {
+            configs[c].name = std::string(engineNames[e]) + "/" + configs[c].name;
+            ordered = RunSyntheticScene(configs[c], boardRows, boardCols, boardSize) && ordered;
+        }
+    }
+    GetChessboardSettings() = saved;
+    return ordered ? 0 : -1;
+}
+
+// Bench race mode : hard views(noise, blur and uneven light) with the serial ladder against the race.
+// The race learns the winning rungs on the first pass, the second pass shows the learned order.
+inline int RunDetectorRaceBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    SyntheticConfig config;
+    config.name = "race";
+    config.noiseSigma = 8.0;
+    config.blurSigma = 2.0;
+    config.lightGradient = 0.7;
+    SyntheticCamera cam;
+    std::vector<cv::Mat> views;
+    std::vector<std::vector<cv::Point2f>> trueCorners;
+    if (!RenderBenchViews(config, boardRows, boardCols, boardSize, cam, views, trueCorners))
+        return -1;
+
+    cv::Size patternSize(boardCols, boardRows);
+    double f = 1000.0 / cv::getTickFrequency();
+    std::vector<DetectorConfig> ladder = DefaultDetectorLadder();
+    std::vector<cv::Point2f> corners;
+
+    // serial : try the rungs in the ladder order until one succeeds
+    int serialFound = 0;
+    int64 t = cv::getTickCount();
+    for (const cv::Mat& view : views)
+    {
+        for (const DetectorConfig& rung : ladder)
+        {
+            if (RunDetectorConfig(rung, view, patternSize, corners))
+            {
+                serialFound++;
+                break;
+            }
+        }
+    }
+    double serialMs = (cv::getTickCount() - t) * f;
+
+    std::cout << "===== Detector Race Benchmark (" << views.size() << " views) =====" << std::endl;
+    std::cout << "[serial] found : " << serialFound << ", " << serialMs / views.size() << " ms/view" << std::endl;
+    DetectorRace race(ladder);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int raceFound = 0;
+        t = cv::getTickCount();
+        for (const cv::Mat& view : views)
+            raceFound += race.Detect(view, patternSize, corners) ? 1 : 0;
+        double raceMs = (cv::getTickCount() - t) * f;
+        std::cout << "[race " << (pass == 0 ? "cold" : "learned") << "] found : " << raceFound << ", "
+            << raceMs / views.size() << " ms/view (x" << serialMs / raceMs << ")" << std::endl;
+    }
+    race.PrintStats();
+    return 0;
+}
+
+// Bench subpix mode : fixed 21x21 window against the adaptive window on the same detected corners
+inline int RunSubPixBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    SyntheticConfig config;
+    config.name = "subpix";
+    config.noiseSigma = 4.0;
+    config.blurSigma = 1.0;
+    SyntheticCamera cam;
+    std::vector<cv::Mat> views;
+    std::vector<std::vector<cv::Point2f>> trueCorners;
+    if (!RenderBenchViews(config, boardRows, boardCols, boardSize, cam, views, trueCorners))
+        return -1;
+
+    cv::Size patternSize(boardCols, boardRows);
+    std::vector<cv::Mat> usedViews;
+    std::vector<std::vector<cv::Point2f>> rawCorners, usedTruth;
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        std::vector<cv::Point2f> corners;
+        if (!cv::findChessboardCorners(views[i], patternSize, corners))
+            continue;
+        AlignToTruth(corners, trueCorners[i]);
+        usedViews.push_back(views[i]);
+        rawCorners.push_back(corners);
+        usedTruth.push_back(trueCorners[i]);
+    }
+    if (usedViews.empty())
+    {
+        std::cout << "[Err] Board not found in the synthetic views" << std::endl;
+        return -1;
+    }
+
+    SubPixSettings fixedSettings, adaptiveSettings;
+    adaptiveSettings.adaptive = true;
+    const int repeat = 5;
+    double elapsed[2] = { 0.0, 0.0 };
+    std::vector<std::vector<cv::Point2f>> refined[2];
+    for (int m = 0; m < 2; m++)
+    {
+        const SubPixSettings& settings = (m == 0) ? fixedSettings : adaptiveSettings;
+        for (int r = 0; r < repeat; r++)
+        {
+            refined[m] = rawCorners;
+            int64 t = cv::getTickCount();
+            for (size_t i = 0; i < usedViews.size(); i++)
+                RefineCorners(usedViews[i], refined[m][i], patternSize, settings);
+            elapsed[m] += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        }
+        elapsed[m] /= repeat * usedViews.size();
+    }
+
+    double errFixed = MeanCornerError(refined[0], usedTruth);
+    double errAdaptive = MeanCornerError(refined[1], usedTruth);
+    cv::Size window = AdaptiveSubPixWindow(rawCorners[0], patternSize, adaptiveSettings.windowRatio);
+    std::cout << "===== SubPix Window Benchmark (" << usedViews.size() << " views) =====" << std::endl;
+    std::cout << "Unrefined corner err : " << MeanCornerError(rawCorners, usedTruth) << " px" << std::endl;
+    std::cout << "Fixed    (" << SUBPIX_FIXED_WINDOW << " px) : " << elapsed[0] << " ms/view, err : " << errFixed << " px" << std::endl;
+    std::cout << "Adaptive (" << window.width << " px in view 0) : " << elapsed[1] << " ms/view, err : " << errAdaptive << " px" << std::endl;
+    std::cout << "Time saved : " << (1.0 - elapsed[1] / elapsed[0]) * 100.0 << " %, error change : "
+        << errAdaptive - errFixed << " px" << std::endl;
+    return 0;
+}
+
+// Bench subpix-engine mode : CornerSubPixParallel against cv::cornerSubPix on 4K views
+inline int RunSubPixEngineBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    SyntheticConfig config;
+    config.name = "subpix-engine";
+    config.imageSize = cv::Size(3840, 2160);
+    config.viewNum = 10;
+    config.noiseSigma = 4.0;
+    config.blurSigma = 1.0;
+    SyntheticCamera cam;
+    std::vector<cv::Mat> views;
+    std::vector<std::vector<cv::Point2f>> trueCorners;
+    if (!RenderBenchViews(config, boardRows, boardCols, boardSize, cam, views, trueCorners))
+        return -1;
+
+    cv::Size patternSize(boardCols, boardRows);
+    SubPixSettings settings[2];
+    settings[1].engine = SUBPIX_ENGINE_PARALLEL;
+    double elapsed[2] = { 0.0, 0.0 };
+    double maxDiff = 0.0;
+    int viewNum = 0;
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        std::vector<cv::Point2f> rawCorners;
+        if (!cv::findChessboardCorners(views[i], patternSize, rawCorners))
+            continue;
+        std::vector<cv::Point2f> refined[2];
+        for (int m = 0; m < 2; m++)
+        {
+            refined[m] = rawCorners;
+            int64 t = cv::getTickCount();
+            RefineCorners(views[i], refined[m], patternSize, settings[m]);
+            elapsed[m] += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        }
+        for (size_t k = 0; k < rawCorners.size(); k++)
+        {
+            maxDiff = std::max(maxDiff, (double)std::abs(refined[0][k].x - refined[1][k].x));
+            maxDiff = std::max(maxDiff, (double)std::abs(refined[0][k].y - refined[1][k].y));
+        }
+        viewNum++;
+    }
+    if (viewNum == 0)
+    {
+        std::cout << "[Err] Board not found in the synthetic views" << std::endl;
+        return -1;
+    }
+
+    std::cout << "===== SubPix Engine Benchmark (" << viewNum << " views, " << config.imageSize << ", "
+        << boardRows * boardCols << " corners, " << cv::getNumThreads() << " threads) =====" << std::endl;
+    std::cout << "cv::cornerSubPix     : " << elapsed[0] / viewNum << " ms/view" << std::endl;
+    std::cout << "CornerSubPixParallel : " << elapsed[1] / viewNum << " ms/view (x" << elapsed[0] / elapsed[1] << ")" << std::endl;
+    std::cout << "Max difference : " << maxDiff << " px " << (maxDiff <= 1e-3 ? "[PASS]" : "[FAIL]") << std::endl;
+    return maxDiff <= 1e-3 ? 0 : -1;
+}
+
+// Bench live-alloc mode : the live pose path on synthetic frames, counting the heap allocations per frame after warm-up.
+// Each view is held for a few frames like a board in front of the camera.
+inline int RunLiveAllocBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    SyntheticConfig config;
+    config.name = "live";
+    SyntheticCamera cam;
+    std::vector<cv::Mat> views;
+    std::vector<std::vector<cv::Point2f>> trueCorners;
+    if (!RenderBenchViews(config, boardRows, boardCols, boardSize, cam, views, trueCorners))
+        return -1;
+
+    LivePoseTracker tracker(boardRows, boardCols, boardSize, cam.camIntrinsic, cam.camDistort);
+    const int hold = 3;
+    for (const cv::Mat& view : views)
+    {
+        for (int h = 0; h < hold; h++)
+            tracker.Process(view);
+    }
+    tracker.MarkWarm();
+
+    int frameNum = 0, foundNum = 0;
+    long long allocTotal = 0, allocMax = 0;
+    int64 ticks = 0;
+    for (const cv::Mat& view : views)
+    {
+        for (int h = 0; h < hold; h++)
+        {
+            long long before = AllocationCount();
+            int64 t = cv::getTickCount();
+            foundNum += tracker.Process(view) ? 1 : 0;
+            ticks += cv::getTickCount() - t;
+            long long allocs = AllocationCount() - before;
+            allocTotal += allocs;
+            allocMax = std::max(allocMax, allocs);
+            frameNum++;
+        }
+    }
+
+    std::cout << "===== Live Allocation Benchmark (" << frameNum << " frames) =====" << std::endl;
+    std::cout << "Found : " << foundNum << ", " << ticks * 1000.0 / cv::getTickFrequency() / frameNum << " ms/frame" << std::endl;
+    std::cout << (tracker.BuffersStable() ? "[PASS] : " : "[FAIL] : ") << "live buffers kept their storage after warm-up" << std::endl;
+    if (AllocationCount() < 0)
+        std::cout << "Allocation count : build with CALIB_COUNT_ALLOCS(and Alloc_Counter.cpp) to enable the hook" << std::endl;
+    else
+        std::cout << "Allocations : " << (double)allocTotal / frameNum << " per frame (max " << allocMax << ")" << std::endl;
+    return tracker.BuffersStable() ? 0 : -1;
+}
+
+// Bench projection mode : the specialized kernels against cv::projectPoints on one board pose per model
+inline int RunProjectionBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    SyntheticCamera cam = DefaultSyntheticCamera(cv::Size(1920, 1080));
+    std::vector<cv::Point3f> objPoint = BuildObjectPoint(boardRows, boardCols, boardSize);
+    cv::Mat rvec = (cv::Mat_<double>(3, 1) << 0.3, -0.2, 0.1);
+    cv::Mat tvec = (cv::Mat_<double>(3, 1) << -boardCols * boardSize * 0.5, -boardRows * boardSize * 0.5, boardCols * boardSize * 2.0);
+    std::vector<cv::Mat> distorts;
+    distorts.push_back(cv::Mat::zeros(1, 5, CV_64F));
+    distorts.push_back((cv::Mat_<double>(1, 5) << 0.08, -0.08, 0.0, 0.0, 0.01));
+    distorts.push_back(cam.camDistort);
+    distorts.push_back((cv::Mat_<double>(1, 8) << 0.08, -0.08, 0.001, -0.001, 0.01, 0.02, -0.01, 0.003));
+
+    const int repeat = 20000;
+    double f = 1000000.0 / cv::getTickFrequency() / repeat;
+    std::cout << "===== Projection Benchmark (" << objPoint.size() << " points) =====" << std::endl;
+    for (const cv::Mat& camDistort : distorts)
+    {
+        PointProjector projector(cam.camIntrinsic, camDistort);
+        std::vector<cv::Point2f> reference, projected;
+        int64 t = cv::getTickCount();
+        for (int r = 0; r < repeat; r++)
+            cv::projectPoints(objPoint, rvec, tvec, cam.camIntrinsic, camDistort, reference);
+        double opencvUs = (cv::getTickCount() - t) * f;
+        t = cv::getTickCount();
+        for (int r = 0; r < repeat; r++)
+            projector.Project(objPoint, rvec, tvec, projected);
+        double kernelUs = (cv::getTickCount() - t) * f;
+
+        double maxErr = 0.0;
+        for (size_t k = 0; k < objPoint.size(); k++)
+            maxErr = std::max(maxErr, (double)cv::norm(projected[k] - reference[k]));
+        std::cout << "[" << projector.ModelName() << "] projectPoints : " << opencvUs << " us, kernel : " << kernelUs
+            << " us (x" << opencvUs / kernelUs << "), max diff : " << maxErr << " px" << std::endl;
+    }
+    return 0;
+}
+
+// Bench fixed-board mode : the compile-time board engine against the runtime fallback on the same frames.
+// Detection dominates the frame, so the time after detection(validation, pose, RMS) is reported on its own.
+inline int RunFixedBoardBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    cv::Ptr<BoardPoseEngine> engines[2] = { CreateBoardPoseEngine(boardRows, boardCols, boardSize),
+        cv::makePtr<DynamicBoardEngine>(boardRows, boardCols, boardSize) };
+    if (engines[0]->Name() == engines[1]->Name())
+    {
+        std::cout << "[Err] No fixed engine for " << boardRows << " x " << boardCols << " (7x10, 6x9, 9x6, 8x11)" << std::endl;
+        return -1;
+    }
+
+    SyntheticConfig config;
+    config.name = "fixed-board";
+    SyntheticCamera cam;
+    std::vector<cv::Mat> views;
+    std::vector<std::vector<cv::Point2f>> trueCorners;
+    if (!RenderBenchViews(config, boardRows, boardCols, boardSize, cam, views, trueCorners))
+        return -1;
+
+    const int repeat = 50;
+    double f = 1000.0 / cv::getTickFrequency();
+    double poseMs[2] = { 0.0, 0.0 };
+    std::cout << "===== Fixed Board Benchmark (" << views.size() << " views) =====" << std::endl;
+    for (int e = 0; e < 2; e++)
+    {
+        cv::Mat rvec(3, 1, CV_64F), tvec(3, 1, CV_64F);
+        int foundNum = 0;
+        double detectMs = 0.0, rms = 0.0;
+        for (const cv::Mat& view : views)
+        {
+            int64 t = cv::getTickCount();
+            bool found = engines[e]->Detect(view);
+            detectMs += (cv::getTickCount() - t) * f;
+            if (!found)
+                continue;
+            foundNum++;
+            t = cv::getTickCount();
+            for (int r = 0; r < repeat; r++)
+                rms = engines[e]->Pose(cam.camIntrinsic, cam.camDistort, rvec, tvec, r > 0);
+            poseMs[e] += (cv::getTickCount() - t) * f / repeat;
+        }
+        std::cout << "[" << engines[e]->Name() << "] found : " << foundNum << ", detect : " << detectMs / views.size()
+            << " ms/frame, pose : " << (foundNum ? poseMs[e] * 1000.0 / foundNum : 0.0) << " us/frame, last rms : " << rms << " px"
+            << std::endl;
+    }
+    std::cout << "Pose latency gain : x" << (poseMs[0] > 0.0 ? poseMs[1] / poseMs[0] : 0.0) << std::endl;
+    return 0;
+}
+
+// Bench pnp mode : the pose solvers of the live loop on a still board with noisy corners.
+// Each pose is held for frameNum frames with fresh noise, like the corners of a board held in front of the camera;
+// the spread of the translation over the frames is the jitter, the rotation is compared to the true pose.
+inline int RunPlanarPoseBenchmark(int boardRows, int boardCols, float boardSize)
+{
+    SyntheticCamera cam = DefaultSyntheticCamera(cv::Size(1920, 1080));
+    PointProjector projector(cam.camIntrinsic, cam.camDistort);
+    std::vector<cv::Point3f> objPoint = BuildObjectPoint(boardRows, boardCols, boardSize);
+    double distance = boardCols * boardSize * 2.0;
+    // the first two views are almost front on, where the two IPPE solutions are closest
+    std::vector<cv::Vec3d> rotations = { cv::Vec3d(0.02, -0.01, 0.0), cv::Vec3d(0.0, 0.05, 0.1), cv::Vec3d(0.3, -0.2, 0.1),
+        cv::Vec3d(-0.4, 0.3, -0.2), cv::Vec3d(0.1, 0.6, 0.3) };
+    const int frameNum = 200;
+    const double noiseSigma = 0.3;          // corner noise(px)
+    const char* names[3] = { "ransac", "ransac + iterative", "planar ippe + lm" };
+
+    std::cout << "===== Planar Pose Benchmark (" << rotations.size() << " poses x " << frameNum << " frames, noise "
+        << noiseSigma << " px) =====" << std::endl;
+    double usPerFrame[3] = { 0.0, 0.0, 0.0 };
+    for (int s = 0; s < 3; s++)
+    {
+        cv::RNG rng(12345);
+        PlanarPoseEstimator planar;
+        double ticks = 0.0, jitter = 0.0, rotErr = 0.0;
+        int flipNum = 0;
+        for (const cv::Vec3d& rotation : rotations)
+        {
+            cv::Mat rvecTrue(rotation), tvecTrue = (cv::Mat_<double>(3, 1) << -boardCols * boardSize * 0.5,
+                -boardRows * boardSize * 0.5, distance);
+            cv::Matx33d Rtrue = RodriguesToMatrix(rotation);
+            std::vector<cv::Point2f> truth, corners;
+            projector.Project(objPoint, rvecTrue, tvecTrue, truth);
+
+            cv::Mat rvec(3, 1, CV_64F, cv::Scalar(0)), tvec(3, 1, CV_64F, cv::Scalar(0));
+            std::vector<cv::Vec3d> translations;
+            for (int f = 0; f < frameNum; f++)
+            {
+                corners = truth;
+                for (cv::Point2f& p : corners)
+                    p += cv::Point2f((float)rng.gaussian(noiseSigma), (float)rng.gaussian(noiseSigma));
+                bool hasPose = f > 0;
+                int64 t = cv::getTickCount();
+                if (s == 2)
+                    planar.Estimate(objPoint, corners, cam.camIntrinsic, cam.camDistort, projector, rvec, tvec, hasPose);
+                else if (s == 1 && hasPose)
+                    cv::solvePnP(objPoint, corners, cam.camIntrinsic, cam.camDistort, rvec, tvec, true, cv::SOLVEPNP_ITERATIVE);
+                else
+                    cv::solvePnPRansac(objPoint, corners, cam.camIntrinsic, cam.camDistort, rvec, tvec);
+                ticks += (double)(cv::getTickCount() - t);
+
+                translations.push_back(cv::Vec3d(tvec));
+                double err = RotationDistance(Rtrue, RodriguesToMatrix(cv::Vec3d(rvec))) * 180.0 / CV_PI;
+                rotErr += err * err;
+                flipNum += err > 5.0 ? 1 : 0;
+            }
+            cv::Vec3d mean;
+            for (const cv::Vec3d& t : translations)
+                mean += t * (1.0 / frameNum);
+            for (const cv::Vec3d& t : translations)
+                jitter += (t - mean).dot(t - mean);
+        }
+        int total = (int)rotations.size() * frameNum;
+        usPerFrame[s] = ticks * 1000000.0 / cv::getTickFrequency() / total;
+        std::cout << "[" << names[s] << "] " << usPerFrame[s] << " us/frame, translation jitter : " << std::sqrt(jitter / total)
+            << " mm, rotation error : " << std::sqrt(rotErr / total) << " deg, flips(> 5 deg) : " << flipNum;
+        if (s == 2)
+            std::cout << ", second solution kept : " << planar.OverrideCount();
+        std::cout << std::endl;
+    }
+    std::cout << "Planar latency gain : x" << usPerFrame[1] / usPerFrame[2] << " over ransac + iterative, x"
+        << usPerFrame[0] / usPerFrame[2] << " over ransac" << std::endl;
+    return 0;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <opencv2/features2d.hpp>
+
+#include "Calib_Common.h"
+#include "Charuco_Board.h"
+
+// Common interface of the calibration targets.
+// Detect fills the image points and the matching board points of one view,
+// so targets that see only a part of the board(ChArUco) fit the same solver.
+class TargetDetector
+{
+public:
+    virtual ~TargetDetector() {}
+    virtual std::string Name() const = 0;
+    virtual bool Detect(const cv::Mat& gray, std::vector<cv::Point2f>& imgPoint, std::vector<cv::Point3f>& objPoint) const = 0;
+};
+
+class ChessboardTargetDetector : public TargetDetector
+{
+public:
+    ChessboardTargetDetector(int boardRows, int boardCols, float boardSize, int engine = CHESSBOARD_ENGINE_OPENCV)
+        : patternSize_(boardCols, boardRows), objPoint_(BuildObjectPoint(boardRows, boardCols, boardSize))
+    {
+        settings_.engine = engine;
+    }
+
+    std::string Name() const override { return settings_.engine == CHESSBOARD_ENGINE_SADDLE ? "saddle" : "chessboard"; }
+
+    bool Detect(const cv::Mat& gray, std::vector<cv::Point2f>& imgPoint, std::vector<cv::Point3f>& objPoint) const override
+    {
+        if (!FindChessboard(gray, patternSize_, imgPoint, settings_))
+            return false;
+        RefineCorners(gray, imgPoint, patternSize_);
+        objPoint = objPoint_;
+        return true;
+    }
+
+private:
+    cv::Size patternSize_;
+    std::vector<cv::Point3f> objPoint_;
+    ChessboardSettings settings_;
+};
+
+// Symmetric or asymmetric circle grid(boardRows x boardCols circles, boardSize is the center distance)
+class CirclesGridTargetDetector : public TargetDetector
+{
+public:
+    CirclesGridTargetDetector(int boardRows, int boardCols, float boardSize, bool asymmetric, bool clustering, bool whiteCircles = false)
+        : patternSize_(boardCols, boardRows), asymmetric_(asymmetric)
+    {
+        flags_ = asymmetric ? cv::CALIB_CB_ASYMMETRIC_GRID : cv::CALIB_CB_SYMMETRIC_GRID;
+        // clustering is faster and more robust to perspective than the default graph search
+        if (clustering)
+            flags_ |= cv::CALIB_CB_CLUSTERING;
+
+        cv::SimpleBlobDetector::Params blobParams;
+        blobParams.maxArea = 1e5f;          // the default(5000) misses circles of high resolution images
+        blobParams.blobColor = whiteCircles ? 255 : 0;
+        blobDetector_ = cv::SimpleBlobDetector::create(blobParams);
+        gridParams_.gridType = asymmetric ? cv::CirclesGridFinderParameters::ASYMMETRIC_GRID
+                                          : cv::CirclesGridFinderParameters::SYMMETRIC_GRID;
+
+        if (!asymmetric)
+            objPoint_ = BuildObjectPoint(boardRows, boardCols, boardSize);
+        else
+        {
+            // every other row is shifted by half a pitch
+            for (int m = 0; m < boardRows; m++)
+            {
+                for (int n = 0; n < boardCols; n++)
+                    objPoint_.push_back(cv::Point3f((2 * n + m % 2) * boardSize, m * boardSize, 0.0f));
+            }
+        }
+    }
+
+    std::string Name() const override
+    {
+        std::string name = asymmetric_ ? "circles_asym" : "circles";
+        return (flags_ & cv::CALIB_CB_CLUSTERING) ? name + "_cluster" : name;
+    }
+
+    bool Detect(const cv::Mat& gray, std::vector<cv::Point2f>& imgPoint, std::vector<cv::Point3f>& objPoint) const override
+    {
+        if (!cv::findCirclesGrid(gray, patternSize_, imgPoint, flags_, blobDetector_, gridParams_))
+            return false;
+        objPoint = objPoint_;
+        return true;
+    }
+
+private:
+    cv::Size patternSize_;
+    bool asymmetric_;
+    int flags_;
+    cv::Ptr<cv::FeatureDetector> blobDetector_;
+    cv::CirclesGridFinderParameters gridParams_;
+    std::vector<cv::Point3f> objPoint_;
+};
+
+class CharucoTargetDetector : public TargetDetector
+{
+public:
+    CharucoTargetDetector(int boardRows, int boardCols, float boardSize)
+        : board_(CreateCharucoBoard(boardRows, boardCols, boardSize)) {}
+
+    std::string Name() const override { return "charuco"; }
+
+    bool Detect(const cv::Mat& gray, std::vector<cv::Point2f>& imgPoint, std::vector<cv::Point3f>& objPoint) const override
+    {
+        std::vector<int> ids;
+        if (DetectCharuco(gray, board_, imgPoint, ids) < CHARUCO_MIN_CORNERS)
+            return false;
+        objPoint.resize(ids.size());
+        for (size_t k = 0; k < ids.size(); k++)
+            objPoint[k] = board_->chessboardCorners[ids[k]];
+        return true;
+    }
+
+private:
+    cv::Ptr<cv::aruco::CharucoBoard> board_;
+};
+
+// chessboard | saddle | circles | circles_asym | charuco, "_cluster" selects CALIB_CB_CLUSTERING for circle grids
+inline cv::Ptr<TargetDetector> CreateTargetDetector(const std::string& name, int boardRows, int boardCols, float boardSize)
+{
+    bool clustering = name.size() > 8 && name.compare(name.size() - 8, 8, "_cluster") == 0;
+    std::string base = clustering ? name.substr(0, name.size() - 8) : name;
+    if (base == "chessboard")
+        return cv::makePtr<ChessboardTargetDetector>(boardRows, boardCols, boardSize);
+    if (base == "saddle")
+        return cv::makePtr<ChessboardTargetDetector>(boardRows, boardCols, boardSize, CHESSBOARD_ENGINE_SADDLE);
+    if (base == "circles")
+        return cv::makePtr<CirclesGridTargetDetector>(boardRows, boardCols, boardSize, false, clustering);
+    if (base == "circles_asym")
+        return cv::makePtr<CirclesGridTargetDetector>(boardRows, boardCols, boardSize, true, clustering);
+    if (base == "charuco")
+        return cv::makePtr<CharucoTargetDetector>(boardRows, boardCols, boardSize);
+    return cv::Ptr<TargetDetector>();
+}
+
+// Run one detector over all images in parallel, calibrate, and report latency and reprojection error
+inline bool BenchmarkTargetDetector(const TargetDetector& detector, const std::vector<cv::Mat>& grayImg)
+{
+    int viewNum = (int)grayImg.size();
+    std::vector<std::vector<cv::Point2f>> imgPoints(viewNum);
+    std::vector<std::vector<cv::Point3f>> objPoints(viewNum);
+    std::vector<uchar> found(viewNum, 0);
+    std::vector<double> latency(viewNum, 0.0);
+
+    int64 tick = cv::getTickCount();
+    cv::parallel_for_(cv::Range(0, viewNum), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            int64 t = cv::getTickCount();
+            found[i] = detector.Detect(grayImg[i], imgPoints[i], objPoints[i]) ? 1 : 0;
+            latency[i] = (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        }
+    });
+    double wallMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+    std::vector<std::vector<cv::Point2f>> usedImg;
+    std::vector<std::vector<cv::Point3f>> usedObj;
+    double latencySum = 0.0, latencyMax = 0.0;
+    for (int i = 0; i < viewNum; i++)
+    {
+        latencySum += latency[i];
+        latencyMax = std::max(latencyMax, latency[i]);
+        if (found[i])
+        {
+            usedImg.push_back(imgPoints[i]);
+            usedObj.push_back(objPoints[i]);
+        }
+    }
+
+    std::cout << "[" << detector.Name() << "] found : " << usedImg.size() << " / " << viewNum
+        << ", latency mean / max : " << latencySum / viewNum << " / " << latencyMax << " ms"
+        << ", wall : " << wallMs << " ms";
+    if (usedImg.size() < 3)
+    {
+        std::cout << ", not enough views to calibrate" << std::endl;
+        return false;
+    }
+    cv::Mat camIntrinsic, camDistort;
+    std::vector<cv::Mat> camRotVec, camTransVec;
+    double rms = cv::calibrateCamera(usedObj, usedImg, grayImg[0].size(), camIntrinsic, camDistort, camRotVec, camTransVec);
+    std::cout << ", rms : " << rms << " px" << std::endl;
+    return true;
+}
+
+// Target mode : compare the detectors on the same temp\N.jpg scenes("all" runs every detector)
+inline int RunTargetBenchmark(int boardRows, int boardCols, float boardSize, const std::string& targetName)
+{
+    std::vector<cv::Mat> srcImg = LoadPatternImages("temp\\");
+    if (srcImg.empty())
+        return -1;
+    // convert once so the latency is the detector only
+    std::vector<cv::Mat> grayImg(srcImg.size());
+    for (size_t i = 0; i < srcImg.size(); i++)
+        cv::cvtColor(srcImg[i], grayImg[i], cv::COLOR_BGR2GRAY);
+
+    std::vector<std::string> names;
+    if (targetName == "all")
+        names = { "chessboard", "saddle", "circles", "circles_cluster", "circles_asym", "circles_asym_cluster", "charuco" };
+    else
+        names.push_back(targetName);
+
+    std::cout << "===== Target Detector Benchmark =====" << std::endl;
+    for (const std::string& name : names)
+    {
+        cv::Ptr<TargetDetector> detector = CreateTargetDetector(name, boardRows, boardCols, boardSize);
+        if (!detector)
+        {
+            std::cout << "[Err] Unknown target : " << name << std::endl;
+            return -1;
+        }
+        BenchmarkTargetDetector(*detector, grayImg);
+    }
+    return 0;
+}